@@ -21,10 +21,15 @@ enum {
     XOC_MAX_PAR_SIZE    = 16,                           /** Max number of parameters */
     XOC_MAX_BLK_NEST    = 100,                          /** Max number of block nest */
     XOC_MAX_BLK_JMP     = 100,                          /** Max number of block JMP */
-    XOC_MAX_HASH_SIZE   = 1024,                         /** Max number of hash table entries */
+    XOC_MIN_HASH_SIZE   = 16,                           /** Min number of hash table slots (one group) */
+    XOC_MAX_REG_SIZE    = 8,                            /** Max number of fiber registers */
+    XOC_MIN_TYPE_PAGE   = 256,                          /** Min number of types per factory page */
+    XOC_MAX_TYPE_DENSE  = 1 << 30,                      /** Max ID of a type kept in a dense cache */
     XOC_MIN_MEM_STACK   = 1024,                         /** Min number of stack (Bytes) */
+    XOC_MIN_STK_REDZONE = 64,                           /** Min number of free stack slots above a frame */
     XOC_MIN_MEM_CHUNK   = 64,                           /** Min number of heap chunk size (Bytes) */
     XOC_MIN_MEM_PAGE    = 1024 * 1024,                  /** Min number of heap page size (Bytes) */
+    XOC_MIN_MEM_ARENA   = 64 * 1024,                    /** Min number of arena chunk size (Bytes) */
     XOC_RET_FROM_ENG    = -2,                           /** Code: Return from engine */
     XOC_RET_FROM_FIB    = -1,                           /** Code: Return from fiber */
 };
@@ -182,6 +187,44 @@ typedef enum xoc_opcode {
     XOC_OP_CHANGE_REF_CNT_ASSIGN,
     XOC_OP_UNARY,
     XOC_OP_BINARY,
+    // -- Typed arithmetic (selected by gen_typed)
+    XOC_OP_NEG_I64,
+    XOC_OP_NEG_F64,
+    XOC_OP_NOT_I64,
+    XOC_OP_BNOT_I64,
+    XOC_OP_ADD_I64,
+    XOC_OP_SUB_I64,
+    XOC_OP_MUL_I64,
+    XOC_OP_DIV_I64,
+    XOC_OP_MOD_I64,
+    XOC_OP_AND_I64,
+    XOC_OP_OR_I64,
+    XOC_OP_XOR_I64,
+    XOC_OP_SHL_I64,
+    XOC_OP_SHR_I64,
+    XOC_OP_EQ_I64,
+    XOC_OP_NE_I64,
+    XOC_OP_LT_I64,
+    XOC_OP_LE_I64,
+    XOC_OP_GT_I64,
+    XOC_OP_GE_I64,
+    XOC_OP_DIV_U64,
+    XOC_OP_MOD_U64,
+    XOC_OP_SHR_U64,
+    XOC_OP_LT_U64,
+    XOC_OP_LE_U64,
+    XOC_OP_GT_U64,
+    XOC_OP_GE_U64,
+    XOC_OP_ADD_F64,
+    XOC_OP_SUB_F64,
+    XOC_OP_MUL_F64,
+    XOC_OP_DIV_F64,
+    XOC_OP_EQ_F64,
+    XOC_OP_NE_F64,
+    XOC_OP_LT_F64,
+    XOC_OP_LE_F64,
+    XOC_OP_GT_F64,
+    XOC_OP_GE_F64,
     XOC_OP_GET_ARRAY_PTR,
     XOC_OP_GET_DYNARRAY_PTR,
     XOC_OP_GET_MAP_PTR,
@@ -195,6 +238,9 @@ typedef enum xoc_opcode {
     XOC_OP_JMP_IFN,
     XOC_OP_JMP_IFEQ,
     XOC_OP_JMP_IFNE,
+    XOC_OP_JMP_IFLT,
+    XOC_OP_JMP_TBL,
+    XOC_OP_JMP_HASH,
     XOC_OP_CALL,
     XOC_OP_CALL_INDIRECT,
     XOC_OP_CALL_EXTERN,
@@ -202,7 +248,8 @@ typedef enum xoc_opcode {
     XOC_OP_RET,
     XOC_OP_ENTER_FRAME,
     XOC_OP_LEAVE_FRAME,
-    XOC_OP_HALT
+    XOC_OP_HALT,
+    XOC_OP_SWITCH,                                      /** Case dispatch, lowered to jumps before code reaches the engine */
 } opcode_t;
 
 typedef enum xoc_devicekind {
@@ -268,31 +315,62 @@ typedef enum xoc_sysfnkind {
     XOC_SYSFN_EXIT
 } sysfnkind_t;
 
+typedef enum xoc_logcat {
+    XOC_LOG_LEXER,
+    XOC_LOG_PARSER,
+    XOC_LOG_GEN,
+    XOC_LOG_ENGINE,
+    XOC_NUM_LOGCAT
+} logcat_t;
+
+typedef enum xoc_loglevel {
+    XOC_LOG_OFF,
+    XOC_LOG_ERROR,
+    XOC_LOG_WARN,
+    XOC_LOG_INFO,
+    XOC_LOG_DEBUG,
+    XOC_LOG_TRACE
+} loglevel_t;
+
+/** Levels above this are compiled out of log_on/log_at */
+#ifndef XOC_LOG_MAX_LEVEL
+#define XOC_LOG_MAX_LEVEL   XOC_LOG_TRACE
+#endif
+
 enum {
     XOC_NUM_KEYWORD = XOC_TOK_WEAK - XOC_TOK_BREAK + 1, /** Number of keywords */
+    XOC_NUM_OPCODE  = XOC_OP_HALT + 1,                  /** Number of opcodes the engine runs */
 };
 
 typedef char xoc_identname[XOC_MAX_STR_LEN + 1];        /** XOC identifier name type 0 */
 typedef xoc_identname identname_t;                      /** XOC identifier name type 1 */
 typedef struct xoc_arg arg_t;                           /** XOC Argument: 64-bits */
 typedef struct xoc_inst inst_t;                         /** XOC Instruction */
+typedef struct xoc_code code_t;                         /** XOC Bytecode: packed instruction */
+typedef struct xoc_prog prog_t;                         /** XOC Bytecode: program */
 typedef struct xoc_info info_t;                         /** XOC Information for Debug/Error */
+typedef struct xoc_linetbl linetbl_t;                   /** XOC Line-start Index */
 typedef void (*xoc_log_fn)(void* context, const char* fmt, ...);
 typedef xoc_log_fn log_fn_t;                            /** XOC Log Function */
 typedef struct xoc_log log_t;                           /** XOC Error Information Report */
 typedef struct xoc_bucket bucket_t;                     /** XOC Hashmap Bucket */
 typedef struct xoc_map map_t;                           /** XOC Hashmap */
+typedef struct xoc_intern intern_t;                     /** XOC Symbol Interner */
 typedef struct xoc_blob blob_t;                         /** XOC Memory Blob */
 typedef struct xoc_pool pool_t;                         /** XOC Memory Pool */
+typedef struct xoc_arenachunk arenachunk_t;             /** XOC Memory Arena Chunk */
+typedef struct xoc_arena arena_t;                       /** XOC Memory Arena */
 typedef struct xoc_mod mod_t;                           /** XOC Module */
 typedef struct xoc_modsrc modsrc_t;                     /** XOC Module Source */
 typedef struct xoc_mods mods_t;                         /** XOC Module List */
 typedef struct xoc_func func_t;                         /** XOC Type: signature */
 typedef struct xoc_param param_t;                       /** XOC Type: parameter layerout */
 typedef struct xoc_type type_t;                         /** XOC Type: tag type */
+typedef struct xoc_typetbl typetbl_t;                   /** XOC Type: interning factory */
 typedef struct xoc_ident ident_t;                       /** XOC Type: identifier */
 typedef struct xoc_token token_t;                       /** XOC Lexer: Token */
 typedef struct xoc_lexer lexer_t;                       /** XOC Lexer: Lexer*/
+typedef struct xoc_tokbuf tokbuf_t;                     /** XOC Lexer: Token Buffer */
 typedef struct xoc_heappage heappage_t;                 /** XOC Heap: Heap Page */
 typedef struct xoc_heap heap_t;                         /** XOC Heap: Heap */
 typedef void (*xoc_extfn) (arg_t* arg, arg_t* res);     /** XOC External Function */
@@ -303,6 +381,7 @@ typedef void (*xoc_sysfn) (fiber_t* fib);               /** XOC System Function
 typedef xoc_sysfn sysfn_t;                              /** XOC System Function */
 typedef struct xoc_engine engine_t;                     /** XOC Engine: Engine */
 typedef struct xoc_parser parser_t;                     /** XOC Parser: Parser */
+typedef struct xoc_unit unit_t;                         /** XOC Parser: Top-level Unit */
 typedef struct xoc_gen gen_t;                           /** XOC Generator: Generator */
 typedef struct xoc_compiler_option compiler_option_t;   /** XOC Compiler: Compiler Option */
 typedef struct xoc_compiler compiler_t;                 /** XOC Compiler: Compiler */
@@ -324,39 +403,85 @@ struct xoc_arg {
     };
 };
 
+struct xoc_linetbl {
+    const char* buf;
+    int buf_len;
+    int* start;                                         /** Byte offset of each line start */
+    int size, cap;
+    int scanned;                                        /** Newlines are indexed below this offset */
+    int gap;                                            /** Source offset where buf skips `gap_len` bytes */
+    int gap_len;
+};
+
 struct xoc_info {
     int   row;
     int   pos;
+    int   off;                                          /** Source offset, resolved through `lines` */
     int   code;
     char* file;
     char* func;
     char* msg;
+    linetbl_t* lines;
 };
 
 struct xoc_log {
     void* context;
     log_fn_t fmt;
+    uint8_t level[XOC_NUM_LOGCAT];                      /** Most verbose level let through, per category */
+};
+
+/** One compare per call site, none for levels above XOC_LOG_MAX_LEVEL */
+#define log_on(log, cat, lvl)   ((lvl) <= XOC_LOG_MAX_LEVEL && (lvl) <= (log)->level[cat])
+#define log_at(log, cat, lvl, ctx, ...) \
+    do { if (log_on(log, cat, lvl)) (log)->fmt(ctx, __VA_ARGS__); } while (0)
+
+struct xoc_arenachunk {
+    arenachunk_t* next;
+    int64_t size;
+};
+
+struct xoc_arena {
+    char* cur;                                          /** Bump pointer in the head chunk */
+    char* end;
+    arenachunk_t* head;                                 /** Chunks, newest first */
+    arenachunk_t* spare;                                /** Chunks kept by arena_reset */
+    int64_t size_chunk;
 };
 
 struct xoc_bucket {
-    bucket_t* next;
     uint64_t key;
     char* data;
 };
 
 struct xoc_map {
+    int8_t* ctrl;                                       /** Control bytes: h2 tag, empty or deleted */
+    bucket_t* buk;
+    int cap;
     int size;
-    bucket_t* buk[XOC_MAX_HASH_SIZE];
+    int num_dead;                                       /** Deleted slots not yet reclaimed */
+    arena_t data;                                       /** Payloads, stable across growth */
+};
+
+struct xoc_intern {
+    char** str;                                         /** Symbol ID -> NUL-terminated name */
+    int* len;
+    uint32_t* hash;
+    int size;                                           /** Number of IDs handed out, 0 is reserved */
+    int cap;
+    uint32_t* slot;                                     /** Open-addressed symbol IDs, 0 is empty */
+    int cap_slot;
+    arena_t data;                                       /** Name bytes */
 };
 
 struct xoc_blob {
     char* data;
-    blob_t* next;
 };
 
 struct xoc_pool {
-    blob_t* head;
-    blob_t* tail;
+    blob_t* blob;                                       /** Dense blob index */
+    int size;
+    int cap;
+    arena_t* arena;                                     /** Owner of blob data, NULL for malloc */
 };
 
 struct xoc_mod {
@@ -389,27 +514,52 @@ struct xoc_mods {
 };
 
 char* xoc_strdup(const char* src);
+void xoc_hash_setseed(uint64_t seed);
 uint64_t xoc_hash(const char* str);
+uint64_t xoc_hashn(const char* str, int len);
 int64_t xoc_align(int64_t size, int64_t align);
 double xoc_pow(double base, int exp);
 bool xoc_isident(char ch);
 int xoc_ch2digit(char ch, int base);
+int xoc_splice(void* base, int elem, int at, int num_del, int from, int size);
 
 void info_init(info_t* info, const char* file, const char* func, int row, int pos, int code);
 void info_setpos(info_t* info, const char* file, const char* func, int row, int pos);
 void info_setmsg(info_t* info, const char* fmt, va_list args);
 void info_free(info_t* info);
+void linetbl_init(linetbl_t* tbl, const char* buf, int buf_len);
+void linetbl_feed(linetbl_t* tbl, const char* data, int off, int len);
+void linetbl_add(linetbl_t* tbl, int off);
+void linetbl_find(linetbl_t* tbl, int off, int* row, int* pos);
+void linetbl_cut(linetbl_t* tbl, const char* buf, int buf_len, int gap, int gap_len, int off);
+void linetbl_free(linetbl_t* tbl);
 void log_fn_info(void* context, const char* fmt, ...);
 void log_init(log_t* log, void* context, log_fn_t fn);
+void log_setlevel(log_t* log, logcat_t cat, loglevel_t level);
 void map_init(map_t* map);
+void map_reserve(map_t* map, int num);
+bucket_t* map_find(map_t* map, uint64_t key);
 char* map_get(map_t* map, uint64_t key);
 uint64_t map_add(map_t* map, char* ptr, int size);
+void map_nadd(map_t* map, char** ptrs, int* sizes, uint64_t* keys, int num);
 void map_del(map_t* map, uint64_t key);
 void map_free(map_t* map);
+void intern_init(intern_t* in);
+uint32_t intern_find(intern_t* in, const char* str, int len);
+uint32_t intern_add(intern_t* in, const char* str, int len);
+uint32_t intern_addh(intern_t* in, const char* str, int len, uint64_t full_hash);
+const char* intern_get(intern_t* in, uint32_t sym);
+int intern_len(intern_t* in, uint32_t sym);
+void intern_free(intern_t* in);
+void arena_init(arena_t* arena, int64_t size_chunk);
+void* arena_alc(arena_t* arena, int64_t size, bool is_zero);
+void arena_reset(arena_t* arena);
+void arena_free(arena_t* arena);
+#define pool_nidx(ptr) (*(uint32_t*)((char*)(ptr) - 4 * sizeof(uint32_t)))
 #define pool_nalign(ptr) (*(uint32_t*)((char*)(ptr) - 3 * sizeof(uint32_t)))
 #define pool_nsize(ptr) (*(uint32_t*)((char*)(ptr) - 2 * sizeof(uint32_t))) 
 #define pool_ncap(ptr) (*(uint32_t*)((char*)(ptr) - sizeof(uint32_t)))
-void pool_init(pool_t *pool);
+void pool_init(pool_t *pool, arena_t* arena);
 void pool_free(pool_t *pool);
 char* pool_at(pool_t* pool, int idx);
 int pool_cap(pool_t* pool);
@@ -421,6 +571,7 @@ blob_t* pool_nset(pool_t* pool, const char* ptr, uint32_t align, uint32_t size,
 char* pool_nalc(pool_t *pool, int align, int size);
 char* pool_nrlc(pool_t* pool, char** pptr, int size);
 char* pool_npush(pool_t* pool, char** pptr, char* new, int size);
+void pool_nsplice(pool_t* pool, int at, int num_del, int from);
 
 
 
@@ -13,22 +13,30 @@
 #include "xoc_types.h"
 #include "xoc_lexer.h"
 #include "xoc_parser.h"
+#include "xoc_gen.h"
 
 struct xoc_compiler_option {
     int argc;
     char** argv;
     bool is_filesys_enabled;
     bool is_impllib_enabled;
+    bool is_pretok_enabled;     // tokenize the whole source before parsing
 };
 
 struct xoc_compiler {
+    arena_t     arena;      // compilation region
     pool_t      idts;       // ident symbols
     pool_t      blks;       // insn blocks
     mods_t      mods;
-    map_t       sym_tbl;    // symbol table
+    intern_t    sym_tbl;    // symbol table
+    intern_t    str_tbl;    // string constants
+    typetbl_t   type_tbl;   // interned types
 
     lexer_t     lex;
+    tokbuf_t    toks;       // pre-tokenized source
     parser_t    prs;
+    gen_t       gen;
+    prog_t      prog;       // packed bytecode
 
     compiler_option_t opt;
     info_t      info;
@@ -36,6 +44,8 @@ struct xoc_compiler {
 };
 
 void compiler_init(compiler_t* cp, const char* file, const char* src, compiler_option_t* opt);
+int  compiler_gen(compiler_t* cp);
+void compiler_edit(compiler_t* cp, int off, int num_del, const char* ins, int num_ins);
 void compiler_free(compiler_t* cp);
 
 
@@ -23,6 +23,12 @@
  *              |   ...                     |               <-- Address 0
  *              +---------------------------+
  * 
+ *          Frame Layout (after CALL + ENTER_FRAME):
+ * 
+ *              base[1]         return pc
+ *              base[0]         caller base
+ *              base[-1 - k]    slot k (temp `$k`)
+ * 
  */
 
 #ifndef XOC_Engine_H
@@ -36,6 +42,11 @@ typedef enum xoc_engine_status{
     ENGINE_STATUS_ERROR
 } engine_status_t;
 
+typedef enum xoc_regkind {
+    XOC_REG_RESULT,                 /** Result of extern/builtin call */
+    XOC_REG_SELF,                   /** Receiver of method call */
+} regkind_t;
+
 
 
 struct xoc_heappage {
@@ -71,7 +82,9 @@ struct xoc_fiber {
     arg_t   * stk_base;
     int       stk_size;
     int64_t   pc;                   /* Execute Instruction pointer */
-    inst_t  * code;                 /* Instructions */
+    code_t  * code;                 /* Instructions */
+    arg_t   * konst;                /* Constant pool */
+    arg_t     reg[XOC_MAX_REG_SIZE];/* Registers */
     fiber_t * src;
     engine_t* eng;
 };
@@ -88,7 +101,11 @@ struct xoc_engine {
 void engine_init    (engine_t* eng, int stack_size, bool is_filesys_enabled, log_t* log);
 void engine_free    (engine_t* eng);
 void engine_reset   (engine_t* eng);
-void engine_loop    (engine_t* eng);
+engine_status_t engine_loop(engine_t* eng);
+engine_status_t engine_run (engine_t* eng, prog_t* prog);
+// Generic operators over slots of the given kinds, false where the VM traps
+bool engine_unary   (arg_t* dst, tokenkind_t tk, typekind_t kind, arg_t* val);
+bool engine_binary  (arg_t* dst, tokenkind_t tk, typekind_t lkind, arg_t* lhs, typekind_t rkind, arg_t* rhs);
 
 
 
@@ -9,27 +9,44 @@
 #ifndef XOC_GEN_H
 #define XOC_GEN_H
 
-#include "xoc_common.h"
+#include "xoc_parser.h"
+
+/** How gen_lower dispatches a switch, picked per switch from its values */
+typedef enum gen_switchkind {
+    GEN_SWITCH_CHAIN,                                   /** One compare per value in source order */
+    GEN_SWITCH_TABLE,                                   /** Dense integers: JMP_TBL indexed by value */
+    GEN_SWITCH_TREE,                                    /** Sparse integers: balanced compares on sorted values */
+    GEN_SWITCH_HASH,                                    /** Strings: JMP_HASH of their contents */
+    GEN_NUM_SWITCH
+} gen_switchkind_t;
+
+enum {
+    GEN_SWITCH_MIN_VALUES   = 4,                        /** Fewer values stay a chain */
+    GEN_SWITCH_MAX_SPAN     = 4096,                     /** Widest value range a table covers */
+    GEN_SWITCH_MIN_FILL     = 40,                       /** Least percent of a table's range with a value */
+    GEN_SWITCH_MAX_HASH     = 12,                       /** Most hash bits, 2^bits buckets of two codes */
+};
 
 struct xoc_gen {
-    int size;
-    int pid;
-
+    int size;                                           /** Number of temps */
+    int pid;                                            /** Number of specialized insts */
+    typekind_t* tmp_kind;                               /** Value kind of each temp */
+    type_t** tmp_val;                                   /** Temp -> operand it folds to, NULL if computed */
+    type_t** key_val;                                   /** Ident -> value of a propagated constant */
+    int num_key;
+    int* sym_slot;                                      /** Module symbol -> slot gen_lower gave it, -1 if none */
+    int num_sym;
+    int num_fold;                                       /** Number of insts folded away */
+    int num_switch[GEN_NUM_SWITCH];                     /** Number of switches lowered per strategy */
+    parser_t* prs;
+    log_t* log;
 };
 
-
-
-
-
-
-
+void gen_init(gen_t* gen, parser_t* prs);
+void gen_typed(gen_t* gen);
+void gen_fold(gen_t* gen);
+int  gen_lower(gen_t* gen, prog_t* prog);
+int  gen_slotof(gen_t* gen, uint32_t sym);
+void gen_free(gen_t* gen);
 
 #endif /* XOC_GEN_H */
-
-
-
-
-
-
-
-
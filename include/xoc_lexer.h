@@ -13,38 +13,81 @@
 
 struct xoc_token {
     tokenkind_t kind;                                   /** Token kind */
-    int row;                                            /** Line number */
-    int pos;                                            /** Position in row */
+    int off;                                            /** Source slice: offset into the buffer */
+    int len;                                            /** Source slice: length, payload length of Str */
     union {
-        uint64_t key;                               /** Identifier hash key */
+        uint32_t key;                               /** Identifier symbol ID */
         int64_t     Int;
         uint64_t    Uint;
-        char*       Str;
+        char*       Str;                            /** `len` bytes, in place when unescaped */
         double      Real;
     };
 };
 
+// Streamed input: fill `buf` with up to `cap` bytes, 0 at end of input
+typedef int (*lexer_readfn_t)(void* ctx, char* buf, int cap);
+
+// A whole module tokenized up front, one array per token field. An edit
+// leaves a gap where it relexed: the tokens past it sit `cap - size` slots
+// further and keep the offsets they had, `shift` behind the source.
+struct xoc_tokbuf {
+    tokenkind_t* kind;
+    int* off;
+    int* len;
+    uint64_t* val;                                      /** Token payload (Int/Real/key/Str), NULL Str is in place */
+    int size;
+    int cap;
+    int pos;                                            /** Next token handed out by lexer_next */
+    int gap;                                            /** First token past the gap */
+    int shift;                                          /** Offset still to add to the tokens past the gap */
+    arena_t strs;                                       /** Decoded escaped literals */
+};
+
+#define tokbuf_slot(toks, i) ((i) < (toks)->gap ? (i) : (i) + (toks)->cap - (toks)->size)
+#define tokbuf_off(toks, i)  ((toks)->off[tokbuf_slot(toks, i)] + ((i) < (toks)->gap ? 0 : (toks)->shift))
+
 struct xoc_lexer {
     bool is_trusted;
-    int row;
-    int pos;
     int buf_pos;
+    int buf_len;
+    bool is_mapped;                                     /** Buffer is a private writable file mapping, cleaned in place copy-on-write */
     char* buf;
+    lexer_readfn_t read;                                /** Streamed input, `buf` is a window over it */
+    void* read_ctx;
+    bool is_eof;                                        /** Streamed input is exhausted */
+    char buf_hidden;                                    /** Byte under the NUL sentinel at buf_len */
+    int buf_base;                                       /** Source offset of buf[0] */
+    int buf_fill;                                       /** Bytes read into the window, past buf_len */
+    int buf_cap;                                        /** Bytes allocated or mapped for buf */
+    int buf_gap;                                        /** Source offset of the gap an edit leaves in buf */
+    int gap_len;                                        /** Bytes in that gap, the source after it follows */
+    linetbl_t lines;                                    /** Row/column of an offset, on demand */
+    char* str_buf;                                      /** Scratch for decoding escaped literals */
+    int str_cap;
     token_t cur;
     token_t prev;
-    pool_t* pool;
-    map_t*  syms;
+    tokbuf_t* toks;                                     /** Replay from here when set */
+    intern_t* syms;
     info_t* info;
     log_t* log;
 };
 
-int  lexer_init (lexer_t* lex, const char* src, bool trusted, pool_t* pool, map_t* syms, info_t* info, log_t* log);
+int  lexer_init (lexer_t* lex, const char* src, bool trusted, intern_t* syms, info_t* info, log_t* log);
+int  lexer_init_file(lexer_t* lex, const char* path, bool trusted, intern_t* syms, info_t* info, log_t* log);
+int  lexer_init_stream(lexer_t* lex, lexer_readfn_t read, void* ctx, bool trusted, intern_t* syms, info_t* info, log_t* log);
+int  lexer_read_file(void* ctx, char* buf, int cap);
 void lexer_free (lexer_t* lex);
+int  lexer_tokenize(lexer_t* lex, tokbuf_t* toks);
+int  lexer_edit(lexer_t* lex, int off, int num_del, const char* ins, int num_ins, int* num_old, int* num_new);
+const char* lexer_src(lexer_t* lex);
+tokenkind_t lexer_peek(lexer_t* lex, int k);
 void lexer_next (lexer_t* lex);
 void lexer_nextf(lexer_t* lex);
 bool lexer_check(lexer_t* lex, tokenkind_t kind);
 void lexer_eat  (lexer_t* lex, tokenkind_t kind);
 const char* lexer_mnemonic(tokenkind_t kind);
+void tokbuf_init(tokbuf_t* toks);
+void tokbuf_free(tokbuf_t* toks);
 tokenkind_t lexer_trans_assign(tokenkind_t kind);
 
 #endif /* XOC_LEXER_H */
\ No newline at end of file
@@ -11,6 +11,14 @@
 
 #include "xoc_engine.h"
 
+// A top-level statement or declaration and what parsing it produced, so an
+// edit only reparses the units it reaches
+struct xoc_unit {
+    int tok_lo, tok_hi;                                 /** Tokens, leading separators included */
+    int blk_lo, blk_hi;                                 /** Instruction blocks */
+    int idt_lo, idt_hi;                                 /** Idents */
+};
+
 struct xoc_parser {
     int iid;
     int bid;
@@ -24,18 +32,34 @@ struct xoc_parser {
     pool_t* blks;
     ident_t* idt_cur;
     pool_t* idts;
-    map_t*  syms;
+    int* idt_top;                                       /** Symbol ID -> innermost visible ident, -1 if none */
+    int cap_top;
+    int scopes[XOC_MAX_BLK_NEST];                       /** Ident count on entering each open scope */
+    int num_scope;
+    uint32_t num_local;                                 /** Block-local idents bound so far, serials never reused */
+    bool is_edit;                                       /** Module names are bound after parser_edit moves them */
+    intern_t* syms;
+    intern_t* strs;                                     /** String constants, one copy per distinct literal */
+    typetbl_t* types;
     lexer_t* lex;
+    unit_t* units;                                      /** Module units, in source order */
+    int num_unit;
+    int cap_unit;
+    int unit_gap;                                       /** First unit past the gap, those sit cap_unit - num_unit slots further */
+    int shift_tok, shift_blk, shift_idt;                /** Still to add to the units past the gap */
 
     info_t* info;
     log_t* log;
 };
 
 
-void parser_init(parser_t* prs, lexer_t* lex, pool_t* blks, pool_t* idts, map_t* syms);
+void parser_init(parser_t* prs, lexer_t* lex, pool_t* blks, pool_t* idts, intern_t* syms, intern_t* strs, typetbl_t* types);
 inst_t* parser_blk_alc(parser_t* prs, int cap);
 inst_t* parser_blk_swc(parser_t* prs, int bid);
 void parser_stmt(parser_t* prs);
+void parser_module(parser_t* prs);
+void parser_edit(parser_t* prs, int lo, int num_old, int num_new);
+unit_t parser_unit_at(parser_t* prs, int i);
 void parser_free(parser_t* prs);
 
 
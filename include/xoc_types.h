@@ -20,6 +20,22 @@ struct xoc_type {
     type_t* next;
 };
 
+struct xoc_typetbl {
+    type_t**    slot;                                   /** Interned nodes, open addressing */
+    int         cap;
+    int         size;
+    type_t*     page;                                   /** Free nodes of the current page */
+    int         num_free;
+    pool_t      pages;                                  /** Node pages, dropped at once */
+    type_t*     toks[XOC_TOK_EOF + 1];                  /** Interned TOK node per token kind */
+    type_t**    tmps;                                   /** Interned TMP node per temp ID */
+    int         num_tmp;
+    type_t**    lbls;                                   /** Interned LBL node per label symbol */
+    int         num_lbl;
+    type_t**    anys;                                   /** Interned ANY node per module name symbol */
+    int         num_any;
+};
+
 struct xoc_func {
     bool is_method;
     int64_t offset;
@@ -28,10 +44,10 @@ struct xoc_func {
 };
 
 struct xoc_ident {
-    uint64_t key;
+    uint32_t key;                                       /** Symbol ID */
 
     identkind_t kind;
-    char* name;
+    const char* name;
 
     uint64_t mod;
     bool is_used;
@@ -40,6 +56,8 @@ struct xoc_ident {
     bool is_global;
 
     type_t* proto;
+    int shadow;                                         /** Ident this one hides while in scope, -1 if none */
+    uint32_t uid;                                       /** Serial of a block-local ident, 0 for a module name */
 
     union {
         int64_t offset;
@@ -57,36 +75,74 @@ struct xoc_param {
 
 
 struct xoc_inst {
-    uint64_t label;
+    uint32_t label;                                     /** Symbol ID of the label/ident */
     opcode_t     opc;
     type_t*      opr[4];
 };
 
-type_t* type_alc(typekind_t kind);
+enum {
+    XOC_DOM_I64,                                        /** Slot holds a widened signed integer */
+    XOC_DOM_U64,                                        /** Slot holds a widened unsigned integer */
+    XOC_DOM_F64,                                        /** Slot holds a double */
+    XOC_DOM_STR,                                        /** Slot holds a string, compared by contents */
+    XOC_MAX_SLOT = UINT16_MAX,                          /** Max number of slots in a frame */
+};
+
+#define code_mode(b, c) ((uint8_t)((b) | ((c) << 2)))
+
+/**
+ * Packed instruction, 16 bytes. Operands are frame slots: temps first, then
+ * locals, then constants (copied in from the program pool by ENTER_FRAME).
+ */
+struct xoc_code {
+    uint8_t     opc;                                    /** Opcode */
+    uint8_t     mode;                                   /** Domains of `b` and `c` for generic ops */
+    uint16_t    a;                                      /** Destination slot */
+    uint16_t    b;                                      /** First source slot */
+    uint16_t    c;                                      /** Second source slot */
+    arg_t       imm;                                    /** Token, jump target, size, ... */
+};
+
+struct xoc_prog {
+    code_t*     code;
+    arg_t*      konst;                                  /** Constant pool */
+    int         num_code;
+    int         num_konst;
+    int         num_slot;                               /** Temps and locals, constants follow */
+};
+
+void typetbl_init(typetbl_t* tbl, arena_t* arena);
+void typetbl_free(typetbl_t* tbl);
+type_t* type_intern(typetbl_t* tbl, type_t* proto);
+type_t* type_dup(typetbl_t* tbl, type_t* type);
+type_t* type_alc(typetbl_t* tbl, typekind_t kind);
 void type_free(type_t* type);
-type_t* type_any(uint64_t key);
-type_t* type_i8(int8_t i8);
-type_t* type_u8(uint8_t u8);
-type_t* type_i16(int16_t i16);
-type_t* type_u16(uint16_t u16);
-type_t* type_i32(int32_t i32);
-type_t* type_u32(uint32_t u32);
-type_t* type_i64(int64_t i64);
-type_t* type_u64(uint64_t u64);
-type_t* type_f32(float f32);
-type_t* type_f64(double f64);
-type_t* type_char(char c);
-type_t* type_str(uint64_t key);
-type_t* type_tok(tokenkind_t tk);
-type_t* type_tmp(int id);
-// type_t* type_idt(uint64_t key);
-type_t* type_blk(int id);
-type_t* type_lbl(uint64_t key);
-type_t* type_dvc(devicekind_t dvc);
-type_t* type_fn(uint64_t key, type_t* proto);
+type_t* type_any(typetbl_t* tbl, uint32_t sym);
+type_t* type_idt(typetbl_t* tbl, ident_t* idt);
+type_t* type_i8(typetbl_t* tbl, int8_t i8);
+type_t* type_u8(typetbl_t* tbl, uint8_t u8);
+type_t* type_i16(typetbl_t* tbl, int16_t i16);
+type_t* type_u16(typetbl_t* tbl, uint16_t u16);
+type_t* type_i32(typetbl_t* tbl, int32_t i32);
+type_t* type_u32(typetbl_t* tbl, uint32_t u32);
+type_t* type_i64(typetbl_t* tbl, int64_t i64);
+type_t* type_u64(typetbl_t* tbl, uint64_t u64);
+type_t* type_f32(typetbl_t* tbl, float f32);
+type_t* type_f64(typetbl_t* tbl, double f64);
+type_t* type_char(typetbl_t* tbl, char c);
+type_t* type_str(typetbl_t* tbl, uint64_t key);
+type_t* type_tok(typetbl_t* tbl, tokenkind_t tk);
+type_t* type_tmp(typetbl_t* tbl, int id);
+// type_t* type_idt(typetbl_t* tbl, uint64_t key);
+type_t* type_blk(typetbl_t* tbl, int id);
+type_t* type_lbl(typetbl_t* tbl, uint32_t sym);
+type_t* type_dvc(typetbl_t* tbl, devicekind_t dvc);
+type_t* type_fn(typetbl_t* tbl, uint32_t sym, type_t* proto);
 int type_size(type_t* type);
-void type_info(type_t* type, char* buf, int len, map_t* syms);
-void inst_info(inst_t* inst, char* buf, int len, map_t* syms);
+void type_info(type_t* type, char* buf, int len, intern_t* syms);
+void inst_info(inst_t* inst, char* buf, int len, intern_t* syms);
+void code_info(code_t* code, char* buf, int len);
+void prog_free(prog_t* prog);
 void ident_info(ident_t* idt, char* buf, int len);
  
 #endif /* XOC_TYPES_H */
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include <xoc_api.h>
 #include <xoc_compiler.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 static char* test_stmt[] = {
     // decl_type
@@ -45,8 +48,10 @@ void test_compiler(int argc, char *argv[]) {
         }
     );
 
+    log_setlevel(&cp.log, XOC_NUM_LOGCAT, XOC_LOG_TRACE);
     lexer_eat(&cp.lex, XOC_TOK_NONE);   // start
     parser_stmt(&cp.prs);
+    compiler_gen(&cp);
 
     compiler_free(&cp);
 }
@@ -70,11 +75,306 @@ void test_engine() {
     log_init(&log, NULL, NULL);
     engine_t eng;
     engine_init(&eng, XOC_MIN_MEM_STACK, true, &log);
-    
+
+    // $0 = sum, $1 = i, $2 = cond, $3.. = constants:
+    // for i := 0; i < 1000000; i = i + 1 { sum = sum + i }
+    arg_t konst[] = { { .I64 = 1000000 }, { .I64 = 1 } };
+    code_t code[] = {
+        { .opc = XOC_OP_ENTER_FRAME, .b = 3, .c = 2, .imm = { .I64 = 5 } },
+        { .opc = XOC_OP_LT_I64,      .a = 2, .b = 1, .c = 3 },
+        { .opc = XOC_OP_JMP_IFN,     .b = 2, .imm = { .I64 = 6 } },
+        { .opc = XOC_OP_ADD_I64,     .a = 0, .b = 0, .c = 1 },
+        { .opc = XOC_OP_ADD_I64,     .a = 1, .b = 1, .c = 4 },
+        { .opc = XOC_OP_JMP,         .imm = { .I64 = 1 } },
+        { .opc = XOC_OP_PUSH,        .b = 0 },
+        { .opc = XOC_OP_HALT },
+    };
+    prog_t prog = { .code = code, .konst = konst, .num_code = 8, .num_konst = 2, .num_slot = 3 };
+    engine_status_t status = engine_run(&eng, &prog);
+    printf("status: %d, sum: %ld\n", status, eng.fib_cur->stk_top->I64);
+
     engine_free(&eng);
 }
 
+static uint64_t bench_djb2(const char* str, int len) {
+    uint64_t hash = 5381;
+    for (int i = 0; i < len; i++) {
+        hash = ((hash << 5) + hash) + str[i];
+    }
+    return hash;
+}
+
+// Identifier-shaped keys: short lowercase/underscore names and counters
+void bench_hash() {
+    enum { NUM_KEY = 4096, NUM_ROUND = 2000 };
+    static char keys[NUM_KEY][32];
+    static int lens[NUM_KEY];
+    static const char* stem[] = { "i", "tmp", "buf_pos", "lexer_next", "parser_stmt_switch", "XOC_TOK_GREATEREQ" };
+    for (int i = 0; i < NUM_KEY; i++) {
+        lens[i] = snprintf(keys[i], sizeof(keys[i]), "%s%d", stem[i % 6], i);
+    }
+    uint64_t sink = 0;
+    clock_t t0 = clock();
+    for (int r = 0; r < NUM_ROUND; r++) {
+        for (int i = 0; i < NUM_KEY; i++) {
+            sink += bench_djb2(keys[i], lens[i]);
+        }
+    }
+    clock_t t1 = clock();
+    for (int r = 0; r < NUM_ROUND; r++) {
+        for (int i = 0; i < NUM_KEY; i++) {
+            sink += xoc_hashn(keys[i], lens[i]);
+        }
+    }
+    clock_t t2 = clock();
+    double n = (double)NUM_KEY * NUM_ROUND;
+    printf("djb2   : %6.2f ns/key\n", (t1 - t0) * 1e9 / CLOCKS_PER_SEC / n);
+    printf("xoc    : %6.2f ns/key\n", (t2 - t1) * 1e9 / CLOCKS_PER_SEC / n);
+    printf("(sink %lu)\n", (unsigned long)(sink & 0xff));
+}
+
+static void bench_log_silent(void* context, const char* fmt, ...) {}
+
+// Indented, comment-heavy source, repeated to a few MB
+void bench_lexer() {
+    enum { NUM_REPEAT = 40000, NUM_ROUND = 5 };
+    static const char* unit =
+        "// Accumulate a running sum over the range\n"
+        "fn acc(lo : i32, hi : i32) : i32 {\n"
+        "        /* The bounds are inclusive on both ends,\n"
+        "         * so the loop runs hi - lo + 1 times. */\n"
+        "        var sum : i32 = 0\n"
+        "        for i := lo; i <= hi; i = i + 1 {\n"
+        "                sum = sum + i * 3      // scaled step\n"
+        "        }\n"
+        "        return sum\n"
+        "}\n\n";
+    int unit_len = strlen(unit);
+    int src_len = unit_len * NUM_REPEAT;
+    char* src = malloc(src_len + 1);
+    for (int i = 0; i < NUM_REPEAT; i++) {
+        memcpy(src + i * unit_len, unit, unit_len);
+    }
+    src[src_len] = '\0';
+
+    info_t info;
+    log_t log;
+    info_init(&info, "bench", "bench", 1, 1, 0);
+    log_init(&log, &info, bench_log_silent);
+    long num_tok = 0;
+    clock_t t0 = clock();
+    for (int r = 0; r < NUM_ROUND; r++) {
+        intern_t syms;
+        lexer_t lex;
+        intern_init(&syms);
+        lexer_init(&lex, src, false, &syms, &info, &log);
+        do {
+            lexer_nextf(&lex);
+            num_tok++;
+        } while (lex.cur.kind != XOC_TOK_EOF && lex.cur.kind != XOC_TOK_NONE);
+        lexer_free(&lex);
+        intern_free(&syms);
+    }
+    clock_t t1 = clock();
+    // Loading alone: copy, UTF-8 validation and line index
+    for (int r = 0; r < NUM_ROUND; r++) {
+        intern_t syms;
+        lexer_t lex;
+        intern_init(&syms);
+        lexer_init(&lex, src, false, &syms, &info, &log);
+        lexer_free(&lex);
+        intern_free(&syms);
+    }
+    clock_t t2 = clock();
+    double sec = (double)(t1 - t0) / CLOCKS_PER_SEC;
+    printf("lexer  : %6.1f MB/s, %ld tokens\n", (double)src_len * NUM_ROUND / sec / 1e6, num_tok / NUM_ROUND);
+    printf("load   : %6.1f MB/s\n", (double)src_len * NUM_ROUND / ((double)(t2 - t1) / CLOCKS_PER_SEC) / 1e6);
+    info_free(&info);
+    free(src);
+}
+
+// A data table of numeric literals: integers, fixed and scientific reals.
+// Every real is also checked against strtod on its own text.
+void bench_number() {
+    enum { NUM_ROW = 200000, NUM_ROUND = 5 };
+    int cap = NUM_ROW * 64, src_len = 0;
+    char* src = malloc(cap);
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < NUM_ROW; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t r = seed >> 11;
+        switch (i % 4) {
+            case 0: src_len += snprintf(src + src_len, cap - src_len, "%lu, ", (unsigned long)(r % 100000000000ULL)); break;
+            case 1: src_len += snprintf(src + src_len, cap - src_len, "%.6f, ", (double)(r % 10000000) / 1000.0); break;
+            case 2: src_len += snprintf(src + src_len, cap - src_len, "%.17g, ", (double)r / (double)(1ULL << 53)); break;
+            case 3: src_len += snprintf(src + src_len, cap - src_len, "%.15e\n", (double)r * 1e-300 * (double)(r % 600)); break;
+        }
+    }
+
+    info_t info;
+    log_t log;
+    info_init(&info, "bench", "bench", 1, 1, 0);
+    log_init(&log, &info, bench_log_silent);
+    long num_tok = 0, num_bad = 0;
+    clock_t t0 = clock();
+    for (int r = 0; r < NUM_ROUND; r++) {
+        intern_t syms;
+        lexer_t lex;
+        intern_init(&syms);
+        lexer_init(&lex, src, false, &syms, &info, &log);
+        do {
+            lexer_nextf(&lex);
+            num_tok++;
+        } while (lex.cur.kind != XOC_TOK_EOF && lex.cur.kind != XOC_TOK_NONE);
+        lexer_free(&lex);
+        intern_free(&syms);
+    }
+    clock_t t1 = clock();
+    {
+        intern_t syms;
+        lexer_t lex;
+        intern_init(&syms);
+        lexer_init(&lex, src, false, &syms, &info, &log);
+        do {
+            lexer_nextf(&lex);
+            if (lex.cur.kind == XOC_TOK_REAL_LIT) {
+                char txt[64];
+                snprintf(txt, sizeof(txt), "%.*s", lex.cur.len, lex.buf + lex.cur.off);
+                num_bad += strtod(txt, NULL) != lex.cur.Real;
+            }
+        } while (lex.cur.kind != XOC_TOK_EOF && lex.cur.kind != XOC_TOK_NONE);
+        lexer_free(&lex);
+        intern_free(&syms);
+    }
+    double sec = (double)(t1 - t0) / CLOCKS_PER_SEC;
+    printf("number : %6.1f MB/s, %ld tokens, %ld misrounded\n", (double)src_len * NUM_ROUND / sec / 1e6, num_tok / NUM_ROUND, num_bad);
+    info_free(&info);
+    free(src);
+}
+
+// One-byte edits in the middle of modules of growing size, against parsing
+// the whole module again
+void bench_edit() {
+    enum { NUM_EDIT = 2000 };
+    static const char* unit =
+        "const lim = 16 - 7\n"
+        "if a <= lim { a = a * b } else if a > 10 { s = 4 - b } else { s = 9 - b }\n"
+        "for i := 0; i < 10; i = i + 1 { a = a + i }\n";
+    int unit_len = strlen(unit);
+    for (int num_repeat = 1000; num_repeat <= 100000; num_repeat *= 10) {
+        int src_len = unit_len * num_repeat;
+        char* src = malloc(src_len + 1);
+        for (int i = 0; i < num_repeat; i++) {
+            memcpy(src + i * unit_len, unit, unit_len);
+        }
+        src[src_len] = '\0';
+        compiler_t cp;
+        clock_t t0 = clock();
+        compiler_init(&cp, NULL, src, &(compiler_option_t){ .is_pretok_enabled = true });
+        lexer_eat(&cp.lex, XOC_TOK_NONE);
+        parser_module(&cp.prs);
+        clock_t t1 = clock();
+        // The first edits move the gaps from the end to the middle `16 - 7`
+        // and make room in the source. Then flip its `7` back and forth, and
+        // type and erase a digit behind it, which shifts everything after it.
+        int off = num_repeat / 2 * unit_len + 17;
+        compiler_edit(&cp, off + 1, 0, "1", 1);
+        compiler_edit(&cp, off + 1, 1, "", 0);
+        clock_t t1e = clock();
+        for (int i = 0; i < NUM_EDIT; i++) {
+            compiler_edit(&cp, off, 1, i % 2 ? "7" : "8", 1);
+        }
+        clock_t t2 = clock();
+        for (int i = 0; i < NUM_EDIT; i++) {
+            compiler_edit(&cp, off + 1, i % 2, "1", 1 - i % 2);
+        }
+        clock_t t3 = clock();
+        printf("edit   : %8d bytes, %6d units: parse %9.1f us, first %8.1f us, replace %6.2f us, insert %6.2f us\n", src_len, cp.prs.num_unit,
+            (t1 - t0) * 1e6 / CLOCKS_PER_SEC, (t1e - t1) * 1e6 / CLOCKS_PER_SEC,
+            (t2 - t1e) * 1e6 / CLOCKS_PER_SEC / NUM_EDIT, (t3 - t2) * 1e6 / CLOCKS_PER_SEC / NUM_EDIT);
+        compiler_free(&cp);
+        free(src);
+    }
+}
+
+// Binary operators by binding power, as the generator prints them
+static const struct { const char* txt; int prec; } bench_ops[] = {
+    { "*", 5 }, { "/", 5 }, { "%", 5 }, { "<<", 5 }, { ">>", 5 }, { "&", 5 },
+    { "+", 4 }, { "-", 4 }, { "|", 4 }, { "~", 4 },
+    { "==", 3 }, { "!=", 3 }, { "<", 3 }, { ">=", 3 },
+    { "&&", 2 }, { "||", 1 },
+};
+
+// Random expression tree of the given depth, parenthesised only where the
+// precedence needs it, so left-leaning chains like `a - b + c` stay flat.
+// `is_paren` wraps every operator and leaves out && and ||: one operator per
+// level, which the per-level grammar before precedence climbing parsed too.
+static int bench_expr_gen(char* buf, int len, int depth, int prec, bool is_rhs, bool is_paren, uint64_t* seed, long* num_op) {
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint64_t r = *seed >> 33;
+    if (depth == 0 || r % 8 == 0) {
+        static const char* leaves[] = { "a", "bb", "cnt", "x1", "7", "42", "-y", "3.5" };
+        return len + sprintf(buf + len, "%s", leaves[r % 8]);
+    }
+    int num = sizeof(bench_ops) / sizeof(bench_ops[0]);
+    int op = r % (is_paren ? num - 2 : num);
+    bool is_wrap = is_paren || bench_ops[op].prec < prec || (is_rhs && bench_ops[op].prec == prec);
+    if (is_wrap) buf[len++] = '(';
+    len = bench_expr_gen(buf, len, depth - 1, bench_ops[op].prec, false, is_paren, seed, num_op);
+    len += sprintf(buf + len, " %s ", bench_ops[op].txt);
+    len = bench_expr_gen(buf, len, depth - 1, bench_ops[op].prec, true, is_paren, seed, num_op);
+    if (is_wrap) buf[len++] = ')';
+    (*num_op)++;
+    return len;
+}
+
+// Assignments of deep expressions, parsed from pretokenized input so the
+// time is spent in the expression grammar: mixed precedence, then every
+// operator in parentheses as a baseline older parsers can be held against
+void bench_expr() {
+    enum { NUM_LINE = 20000, DEPTH = 5, NUM_ROUND = 5 };
+    static const char* names[] = { "expr   ", "paren  " };
+    int cap = NUM_LINE * 512;
+    char* src = malloc(cap);
+    for (int k = 0; k < 2; k++) {
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        long num_op = 0;
+        int src_len = 0;
+        for (int i = 0; i < NUM_LINE; i++) {
+            src_len += sprintf(src + src_len, "v = ");
+            src_len = bench_expr_gen(src, src_len, DEPTH, 0, false, k == 1, &seed, &num_op);
+            src[src_len++] = '\n';
+        }
+        src[src_len] = '\0';
+
+        clock_t sum = 0;
+        int num_blk = 0;
+        for (int r = 0; r < NUM_ROUND; r++) {
+            compiler_t cp;
+            compiler_init(&cp, NULL, src, &(compiler_option_t){ .is_pretok_enabled = true });
+            lexer_eat(&cp.lex, XOC_TOK_NONE);
+            clock_t t0 = clock();
+            parser_module(&cp.prs);
+            sum += clock() - t0;
+            num_blk = cp.prs.num_unit;
+            compiler_free(&cp);
+        }
+        double sec = (double)sum / CLOCKS_PER_SEC;
+        printf("%s: %6.1f MB/s, %ld operators, %d units, %5.1f ns/operator\n", names[k], (double)src_len * NUM_ROUND / sec / 1e6,
+            num_op, num_blk, sec * 1e9 / NUM_ROUND / num_op);
+    }
+    free(src);
+}
+
 int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        if (argc < 3 || strcmp(argv[2], "hash") == 0) bench_hash();
+        if (argc < 3 || strcmp(argv[2], "lexer") == 0) bench_lexer();
+        if (argc < 3 || strcmp(argv[2], "number") == 0) bench_number();
+        if (argc < 3 || strcmp(argv[2], "edit") == 0) bench_edit();
+        if (argc < 3 || strcmp(argv[2], "expr") == 0) bench_expr();
+        return 0;
+    }
     test_compiler(argc, argv);
     // test_map();
     // test_engine();
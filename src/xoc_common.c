@@ -4,6 +4,10 @@
 #include <string.h>
 #include <stdio.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 char* xoc_strdup(const char* src) {
     if (!src) {
         return NULL;
@@ -11,13 +15,94 @@ char* xoc_strdup(const char* src) {
     return strdup(src);
 }
 
-uint64_t xoc_hash(const char* str) {
-    uint64_t hash = 5381;
-    char ch;
-    while ((ch = *str++)) {
-        hash = ((hash << 5) + hash) + ch;
+// wyhash: 8 bytes at a time folded with 64x64->128 multiplies. The seed is
+// process wide; change it before any table is filled.
+static uint64_t xoc_hash_seed = 0;
+static const uint64_t xoc_hash_secret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static inline void xoc_mum(uint64_t* a, uint64_t* b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t xoc_mix(uint64_t a, uint64_t b) {
+    xoc_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t xoc_r8(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t xoc_r4(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+void xoc_hash_setseed(uint64_t seed) {
+    xoc_hash_seed = seed;
+}
+
+uint64_t xoc_hashn(const char* str, int len) {
+    const uint8_t* p = (const uint8_t*)str;
+    const uint64_t* s = xoc_hash_secret;
+    uint64_t seed = xoc_hash_seed ^ xoc_mix(xoc_hash_seed ^ s[0], s[1]);
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (xoc_r4(p) << 32) | xoc_r4(p + ((len >> 3) << 2));
+            b = (xoc_r4(p + len - 4) << 32) | xoc_r4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        int i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = xoc_mix(xoc_r8(p) ^ s[1], xoc_r8(p + 8) ^ seed);
+                see1 = xoc_mix(xoc_r8(p + 16) ^ s[2], xoc_r8(p + 24) ^ see1);
+                see2 = xoc_mix(xoc_r8(p + 32) ^ s[3], xoc_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = xoc_mix(xoc_r8(p) ^ s[1], xoc_r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = xoc_r8(p + i - 16);
+        b = xoc_r8(p + i - 8);
     }
-    return hash;
+    a ^= s[1];
+    b ^= seed;
+    xoc_mum(&a, &b);
+    return xoc_mix(a ^ s[0] ^ (uint64_t)len, b ^ s[1]);
+}
+
+uint64_t xoc_hash(const char* str) {
+    return xoc_hashn(str, strlen(str));
 }
 
 int64_t xoc_align(int64_t size, int64_t align) {
@@ -56,13 +141,37 @@ int xoc_ch2digit(char ch, int base) {
     return -1;
 }
 
+// Replace elements [at, at + num_del) with the tail [from, size) of the same
+// array, keeping [at + num_del, from) in order behind it. Returns the new size.
+int xoc_splice(void* base, int elem, int at, int num_del, int from, int size) {
+    char* p = (char*)base;
+    int num_new = size - from;
+    int num_keep = from - at - num_del;
+    if (num_new == num_del) {
+        memcpy(p + (size_t)at * elem, p + (size_t)from * elem, (size_t)num_new * elem);
+        return size - num_del;
+    }
+    char* tmp = num_new > 0 ? malloc((size_t)num_new * elem) : NULL;
+    if (tmp) {
+        memcpy(tmp, p + (size_t)from * elem, (size_t)num_new * elem);
+    }
+    memmove(p + (size_t)(at + num_new) * elem, p + (size_t)(at + num_del) * elem, (size_t)num_keep * elem);
+    if (tmp) {
+        memcpy(p + (size_t)at * elem, tmp, (size_t)num_new * elem);
+        free(tmp);
+    }
+    return size - num_del;
+}
+
 void info_init(info_t* info, const char* file, const char* func, int row, int pos, int code) {
     info->file = xoc_strdup(file);
     info->func = xoc_strdup(func);
     info->row = row;
     info->pos = pos;
+    info->off = 0;
     info->code = code;
     info->msg = NULL;
+    info->lines = NULL;
 }
 
 void info_setpos(info_t* info, const char* file, const char* func, int row, int pos) {
@@ -71,6 +180,7 @@ void info_setpos(info_t* info, const char* file, const char* func, int row, int
     info->func = xoc_strdup(func);
     info->row = row;
     info->pos = pos;
+    info->lines = NULL;
 }
 
 void info_setmsg(info_t* info, const char* fmt, va_list args) {
@@ -103,6 +213,103 @@ void info_free(info_t* info) {
     }
 }
 
+// Line starts are recorded by the lexer as it loads a source. Past an edit
+// they are indexed lazily: only as far into the source as the furthest
+// offset resolved so far, plus a little read-ahead.
+#define LINETBL_AHEAD 4096
+
+void linetbl_init(linetbl_t* tbl, const char* buf, int buf_len) {
+    tbl->buf = buf;
+    tbl->buf_len = buf_len;
+    tbl->cap = 64;
+    tbl->start = malloc(tbl->cap * sizeof(int));
+    tbl->start[0] = 0;
+    tbl->size = 1;
+    tbl->scanned = 0;
+    tbl->gap = tbl->gap_len = 0;
+}
+
+// Index the newlines of `data`, which holds source bytes [off, off + len)
+void linetbl_feed(linetbl_t* tbl, const char* data, int off, int len) {
+    const char* p = data;
+    const char* end = data + len;
+    const char* nl;
+    while ((nl = memchr(p, '\n', end - p))) {
+        if (tbl->size == tbl->cap) {
+            tbl->cap *= 2;
+            tbl->start = realloc(tbl->start, tbl->cap * sizeof(int));
+        }
+        p = nl + 1;
+        tbl->start[tbl->size++] = off + (p - data);
+    }
+    tbl->scanned = off + len;
+}
+
+// Record a line starting at `off`, after all lines indexed so far
+void linetbl_add(linetbl_t* tbl, int off) {
+    if (tbl->size == tbl->cap) {
+        tbl->cap *= 2;
+        tbl->start = realloc(tbl->start, tbl->cap * sizeof(int));
+    }
+    tbl->start[tbl->size++] = off;
+    tbl->scanned = off;
+}
+
+// Without a buffer (streamed source) lines are only known once fed
+void linetbl_find(linetbl_t* tbl, int off, int* row, int* pos) {
+    if (tbl->buf && off >= tbl->scanned && tbl->scanned < tbl->buf_len) {
+        int lim = off + LINETBL_AHEAD;
+        lim = lim < tbl->buf_len ? lim : tbl->buf_len;
+        // Bytes up to the gap, then the ones behind it
+        int mid = tbl->gap < tbl->scanned ? tbl->scanned : tbl->gap < lim ? tbl->gap : lim;
+        linetbl_feed(tbl, tbl->buf + tbl->scanned, tbl->scanned, mid - tbl->scanned);
+        linetbl_feed(tbl, tbl->buf + mid + tbl->gap_len, mid, lim - mid);
+    }
+    // Diagnostics mostly move forward, so try the last line first
+    int lo = 0, hi = tbl->size - 1;
+    if (tbl->start[hi] <= off) {
+        lo = hi;
+    }
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (tbl->start[mid] <= off) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    *row = lo + 1;
+    *pos = off - tbl->start[lo] + 1;
+}
+
+// Forget lines past `off` after the source was edited there. `buf` holds
+// the source with `gap_len` unused bytes at offset `gap`.
+void linetbl_cut(linetbl_t* tbl, const char* buf, int buf_len, int gap, int gap_len, int off) {
+    int lo = 1, hi = tbl->size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (tbl->start[mid] <= off) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    tbl->size = lo;
+    tbl->buf = buf;
+    tbl->buf_len = buf_len;
+    tbl->gap = gap;
+    tbl->gap_len = gap_len;
+    tbl->scanned = tbl->scanned < off ? tbl->scanned : off;
+}
+
+void linetbl_free(linetbl_t* tbl) {
+    if (tbl->start) {
+        free(tbl->start);
+        tbl->start = NULL;
+    }
+    tbl->size = tbl->cap = 0;
+}
+
 static void log_fn_default(void* context, const char* fmt, ...) {
     va_list args;
     va_start(args, fmt);
@@ -131,6 +338,9 @@ void log_fn_info(void* context, const char* fmt, ...) {
         }
         info->msg = malloc(msg_len + 1);
         vsnprintf(info->msg, msg_len + 1, fmt, argscp);
+        if (info->lines) {
+            linetbl_find(info->lines, info->off, &info->row, &info->pos);
+        }
         printf("\n%s:%d:%d: %s", info->file, info->row, info->pos, info->msg);
     }
     va_end(args);
@@ -140,59 +350,172 @@ void log_fn_info(void* context, const char* fmt, ...) {
 void log_init(log_t* log, void* context, log_fn_t fn) {
     log->context = context;
     log->fmt = fn ? fn : log_fn_default;
+    for (int i = 0; i < XOC_NUM_LOGCAT; i++) {
+        log->level[i] = XOC_LOG_INFO;
+    }
 }
 
-
-void bucket_set(bucket_t* bucket, uint64_t key, char* ptr, int size) {
-    bucket->key = key;
-    if (size > 0) {
-        if (bucket->data) {
-            free(bucket->data);
+// XOC_NUM_LOGCAT sets every category at once
+void log_setlevel(log_t* log, logcat_t cat, loglevel_t level) {
+    for (int i = 0; i < XOC_NUM_LOGCAT; i++) {
+        if (cat == XOC_NUM_LOGCAT || cat == (logcat_t)i) {
+            log->level[i] = level;
         }
-        bucket->data = malloc(size);
-        memcpy(bucket->data, ptr, size);
     }
 }
 
+
+// Swiss-table style map: one control byte per slot holds the low 7 hash
+// bits of a full slot, or EMPTY/DELETED. Slots are probed a 16-byte group
+// at a time, with SSE2 where available.
+#define MAP_EMPTY   ((int8_t)-128)
+#define MAP_DELETED ((int8_t)-2)
+#define MAP_GROUP   16
+
+static inline uint64_t map_mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    return key ^ (key >> 29);
+}
+
+static inline uint32_t map_match(const int8_t* ctrl, int8_t tag) {
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < MAP_GROUP; i++) {
+        mask |= (uint32_t)(ctrl[i] == tag) << i;
+    }
+    return mask;
+#endif
+}
+
+// Empty and deleted both have the sign bit set
+static inline uint32_t map_match_free(const int8_t* ctrl) {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < MAP_GROUP; i++) {
+        mask |= (uint32_t)(ctrl[i] < 0) << i;
+    }
+    return mask;
+#endif
+}
+
+static void map_alc(map_t* map, int cap) {
+    map->cap = cap;
+    map->ctrl = (int8_t*)malloc(cap);
+    map->buk = (bucket_t*)malloc(cap * sizeof(bucket_t));
+    memset(map->ctrl, MAP_EMPTY, cap);
+}
+
 void map_init(map_t* map) {
-    map->size = 0;
-    memset(map->buk, 0, sizeof(bucket_t*) * XOC_MAX_HASH_SIZE);
+    map->size = map->num_dead = 0;
+    map_alc(map, XOC_MIN_HASH_SIZE);
+    arena_init(&map->data, 0);
+}
+
+// First free slot on the probe sequence of `hash`
+static int map_slot(map_t* map, uint64_t hash) {
+    int mask = map->cap - 1;
+    int pos = (hash >> 7) & mask & ~(MAP_GROUP - 1);
+    for (int step = MAP_GROUP;; step += MAP_GROUP) {
+        uint32_t free_mask = map_match_free(map->ctrl + pos);
+        if (free_mask) {
+            return pos + __builtin_ctz(free_mask);
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+static void map_rehash(map_t* map, int cap) {
+    int8_t* ctrl = map->ctrl;
+    bucket_t* buk = map->buk;
+    int old_cap = map->cap;
+    map_alc(map, cap);
+    for (int i = 0; i < old_cap; i++) {
+        if (ctrl[i] >= 0) {
+            uint64_t hash = map_mix(buk[i].key);
+            int at = map_slot(map, hash);
+            map->ctrl[at] = hash & 0x7f;
+            map->buk[at] = buk[i];
+        }
+    }
+    map->num_dead = 0;
+    free(ctrl);
+    free(buk);
+}
+
+// Keep the load (live + deleted) at or under 7/8
+void map_reserve(map_t* map, int num) {
+    if ((int64_t)(num + map->num_dead) * 8 <= (int64_t)map->cap * 7) {
+        return;
+    }
+    int cap = map->cap;
+    while ((int64_t)num * 8 > (int64_t)cap * 7) {
+        cap *= 2;
+    }
+    map_rehash(map, cap);
 }
 
 bucket_t* map_find(map_t* map, uint64_t key) {
-    bucket_t* p = map->buk[key % XOC_MAX_HASH_SIZE];
-    while (p) {
-        if (p->key == key) {
-            return p;
+    uint64_t hash = map_mix(key);
+    int8_t tag = hash & 0x7f;
+    int mask = map->cap - 1;
+    int pos = (hash >> 7) & mask & ~(MAP_GROUP - 1);
+    for (int step = MAP_GROUP;; step += MAP_GROUP) {
+        uint32_t hit = map_match(map->ctrl + pos, tag);
+        while (hit) {
+            int at = pos + __builtin_ctz(hit);
+            if (map->buk[at].key == key) {
+                return &map->buk[at];
+            }
+            hit &= hit - 1;
+        }
+        if (map_match(map->ctrl + pos, MAP_EMPTY) || step > map->cap) {
+            return NULL;
         }
-        p = p->next;
+        pos = (pos + step) & mask;
     }
-    return NULL;
+}
+
+static void map_put(map_t* map, uint64_t key, char* ptr, int size) {
+    if (map_find(map, key)) {
+        return;
+    }
+    map_reserve(map, map->size + 1);
+    uint64_t hash = map_mix(key);
+    int at = map_slot(map, hash);
+    if (map->ctrl[at] == MAP_DELETED) {
+        map->num_dead--;
+    }
+    map->ctrl[at] = hash & 0x7f;
+    map->buk[at].key = key;
+    map->buk[at].data = NULL;
+    if (size > 0) {
+        map->buk[at].data = (char*)arena_alc(&map->data, size, false);
+        memcpy(map->buk[at].data, ptr, size);
+    }
+    map->size++;
 }
 
 uint64_t map_add(map_t* map, char* ptr, int size) {
     uint64_t key = xoc_hash(ptr);
-    bucket_t* p = map_find(map, key);
-    if (!p) {
-        int index = key % XOC_MAX_HASH_SIZE;
-        bucket_t* new_bucket = (bucket_t*)malloc(sizeof(bucket_t));
-        memset(new_bucket, 0, sizeof(bucket_t));
-        bucket_set(new_bucket, key, ptr, size);
-        p = map->buk[index];
-        if (!p) {
-            map->buk[index] = new_bucket;
-        } else {
-            while(p) {
-                if (!p->next) {
-                    p->next = new_bucket;
-                    break;
-                }
-                p = p->next;
-            }
+    map_put(map, key, ptr, size);
+    return key;
+}
+
+void map_nadd(map_t* map, char** ptrs, int* sizes, uint64_t* keys, int num) {
+    map_reserve(map, map->size + num);
+    for (int i = 0; i < num; i++) {
+        uint64_t key = xoc_hash(ptrs[i]);
+        map_put(map, key, ptrs[i], sizes[i]);
+        if (keys) {
+            keys[i] = key;
         }
-        map->size++;
     }
-    return key;
 }
 
 char* map_get(map_t* map, uint64_t key) {
@@ -203,115 +526,250 @@ char* map_get(map_t* map, uint64_t key) {
     return NULL;
 }
 
+// Payloads live in the map's arena and are reclaimed with the map
 void map_del(map_t* map, uint64_t key) {
-    // find prev & now bucket
-    bucket_t* prev = NULL;
-    bucket_t* p = map->buk[key % XOC_MAX_HASH_SIZE];
-    while (p) {
-        if (p->key == key) {
-            break;
+    bucket_t* p = map_find(map, key);
+    if (p) {
+        map->ctrl[p - map->buk] = MAP_DELETED;
+        map->num_dead++;
+        map->size--;
+    }
+}
+
+void map_free(map_t* map) {
+    free(map->ctrl);
+    free(map->buk);
+    map->ctrl = NULL;
+    map->buk = NULL;
+    map->cap = map->size = map->num_dead = 0;
+    arena_free(&map->data);
+}
+
+
+// Interner: every distinct name is stored once and gets a dense 32-bit ID.
+// Lookups compare the bytes, so hash collisions never merge two names.
+void intern_init(intern_t* in) {
+    in->size = 1;
+    in->cap = XOC_MIN_HASH_SIZE;
+    in->str = (char**)calloc(in->cap, sizeof(char*));
+    in->len = (int*)calloc(in->cap, sizeof(int));
+    in->hash = (uint32_t*)calloc(in->cap, sizeof(uint32_t));
+    in->cap_slot = XOC_MIN_HASH_SIZE * 2;
+    in->slot = (uint32_t*)calloc(in->cap_slot, sizeof(uint32_t));
+    arena_init(&in->data, 0);
+}
+
+static uint32_t* intern_probe(intern_t* in, const char* str, int len, uint32_t hash) {
+    for (uint32_t i = hash;; i++) {
+        uint32_t* at = &in->slot[i & (in->cap_slot - 1)];
+        if (*at == 0 || (in->hash[*at] == hash && in->len[*at] == len && memcmp(in->str[*at], str, len) == 0)) {
+            return at;
         }
-        prev = p;
-        p = p->next;
     }
+}
 
-    // delete
-    if (p) {
-        if (prev) {
-            prev->next = p->next;
-        } else {
-            map->buk[key % XOC_MAX_HASH_SIZE] = NULL;
+uint32_t intern_find(intern_t* in, const char* str, int len) {
+    return *intern_probe(in, str, len, (uint32_t)xoc_hashn(str, len));
+}
+
+uint32_t intern_add(intern_t* in, const char* str, int len) {
+    return intern_addh(in, str, len, xoc_hashn(str, len));
+}
+
+// Callers that already hashed the name (e.g. for keyword lookup) pass it on
+uint32_t intern_addh(intern_t* in, const char* str, int len, uint64_t full_hash) {
+    uint32_t hash = (uint32_t)full_hash;
+    uint32_t* at = intern_probe(in, str, len, hash);
+    if (*at) {
+        return *at;
+    }
+    if (in->size == in->cap) {
+        in->cap *= 2;
+        in->str = (char**)realloc(in->str, in->cap * sizeof(char*));
+        in->len = (int*)realloc(in->len, in->cap * sizeof(int));
+        in->hash = (uint32_t*)realloc(in->hash, in->cap * sizeof(uint32_t));
+    }
+    uint32_t sym = in->size++;
+    in->str[sym] = (char*)arena_alc(&in->data, len + 1, false);
+    memcpy(in->str[sym], str, len);
+    in->str[sym][len] = '\0';
+    in->len[sym] = len;
+    in->hash[sym] = hash;
+    *at = sym;
+    // Keep the index at most half full
+    if (in->size * 2 > in->cap_slot) {
+        free(in->slot);
+        in->cap_slot *= 2;
+        in->slot = (uint32_t*)calloc(in->cap_slot, sizeof(uint32_t));
+        for (uint32_t i = 1; i < (uint32_t)in->size; i++) {
+            *intern_probe(in, in->str[i], in->len[i], in->hash[i]) = i;
         }
-        free(p->data);
-        free(p);
-        map->size--;
     }
+    return sym;
 }
 
-void map_free(map_t* map) {
-    for (int i = 0; i < XOC_MAX_HASH_SIZE; i++) {
-        bucket_t* p = map->buk[i];
-        while (p) {
-            bucket_t* next = p->next;
-            free(p->data);
-            free(p);
-            p = next;
+const char* intern_get(intern_t* in, uint32_t sym) {
+    return sym > 0 && sym < (uint32_t)in->size ? in->str[sym] : NULL;
+}
+
+int intern_len(intern_t* in, uint32_t sym) {
+    return sym > 0 && sym < (uint32_t)in->size ? in->len[sym] : 0;
+}
+
+void intern_free(intern_t* in) {
+    free(in->str);
+    free(in->len);
+    free(in->hash);
+    free(in->slot);
+    in->str = NULL;
+    in->len = NULL;
+    in->hash = in->slot = NULL;
+    in->size = in->cap = in->cap_slot = 0;
+    arena_free(&in->data);
+}
+
+
+// Region allocator: bump allocation out of large chunks, everything is
+// released at once. Requests larger than a quarter chunk get a chunk of
+// their own so the current one keeps being filled.
+#define ARENA_ALIGN 16
+
+static arenachunk_t* arena_chunk(arena_t* arena, int64_t size) {
+    arenachunk_t** pp = &arena->spare;
+    while (*pp && (*pp)->size < size) {
+        pp = &(*pp)->next;
+    }
+    arenachunk_t* chunk = *pp;
+    if (chunk) {
+        *pp = chunk->next;
+    } else {
+        chunk = (arenachunk_t*)malloc(xoc_align(sizeof(arenachunk_t), ARENA_ALIGN) + size);
+        chunk->size = size;
+    }
+    return chunk;
+}
+
+void arena_init(arena_t* arena, int64_t size_chunk) {
+    arena->cur = arena->end = NULL;
+    arena->head = arena->spare = NULL;
+    arena->size_chunk = size_chunk ? size_chunk : XOC_MIN_MEM_ARENA;
+}
+
+void* arena_alc(arena_t* arena, int64_t size, bool is_zero) {
+    size = xoc_align(size ? size : 1, ARENA_ALIGN);
+    char* data;
+    if (size > arena->size_chunk / 4) {
+        arenachunk_t* chunk = arena_chunk(arena, size);
+        if (arena->head) {
+            chunk->next = arena->head->next;
+            arena->head->next = chunk;
+        } else {
+            chunk->next = NULL;
+            arena->head = chunk;
+        }
+        data = (char*)chunk + xoc_align(sizeof(arenachunk_t), ARENA_ALIGN);
+    } else {
+        if (arena->end - arena->cur < size) {
+            arenachunk_t* chunk = arena_chunk(arena, arena->size_chunk);
+            chunk->next = arena->head;
+            arena->head = chunk;
+            arena->cur = (char*)chunk + xoc_align(sizeof(arenachunk_t), ARENA_ALIGN);
+            arena->end = arena->cur + chunk->size;
         }
+        data = arena->cur;
+        arena->cur += size;
+    }
+    if (is_zero) {
+        memset(data, 0, size);
+    }
+    return data;
+}
+
+void arena_reset(arena_t* arena) {
+    while (arena->head) {
+        arenachunk_t* next = arena->head->next;
+        arena->head->next = arena->spare;
+        arena->spare = arena->head;
+        arena->head = next;
     }
+    arena->cur = arena->end = NULL;
 }
 
+void arena_free(arena_t* arena) {
+    arena_reset(arena);
+    while (arena->spare) {
+        arenachunk_t* next = arena->spare->next;
+        free(arena->spare);
+        arena->spare = next;
+    }
+}
+
+
+// Blobs are indexed densely; n-blobs additionally carry an inline header
+// of index, align, size and capacity in front of the data, so lookups by
+// index or by data pointer are O(1)
+#define POOL_NHDR   (sizeof(uint32_t) * 4)
 
-void pool_init(pool_t* pool) {
-    pool->head = pool->tail = NULL;
+void pool_init(pool_t* pool, arena_t* arena) {
+    pool->blob = NULL;
+    pool->size = pool->cap = 0;
+    pool->arena = arena;
 }
 
 void pool_free(pool_t* pool) {
-    blob_t *p = pool->head;
-    while (p) {
-        blob_t *next = p->next;
-        free(p->data);
-        free(p);
-        p = next;
+    // Arena-backed data goes away with its arena
+    for (int i = 0; !pool->arena && i < pool->size; i++) {
+        free(pool->blob[i].data);
     }
+    free(pool->blob);
+    pool_init(pool, pool->arena);
 }
 
 char* pool_alc(pool_t* pool, int size) {
-    blob_t *p = (blob_t*)malloc(sizeof(blob_t));
-    p->data = (char*)malloc(size * sizeof(char));
-    memset(p->data, 0, size);
-    p->next = NULL;
-    if (!pool->head) {
-        pool->head = pool->tail = p;
+    if (pool->size == pool->cap) {
+        pool->cap = pool->cap ? pool->cap * 2 : 16;
+        pool->blob = (blob_t*)realloc(pool->blob, pool->cap * sizeof(blob_t));
+    }
+    char* data;
+    if (pool->arena) {
+        data = (char*)arena_alc(pool->arena, size, true);
     } else {
-        pool->tail->next = p;
-        pool->tail = p;
+        data = (char*)malloc(size * sizeof(char));
+        memset(data, 0, size);
     }
-    return pool->tail->data;
+    pool->blob[pool->size].data = data;
+    return pool->blob[pool->size++].data;
 }
 
 int pool_cap(pool_t* pool) {
-    blob_t *p = pool->head;
-    int cap = 0;
-    while (p) {
-        p = p->next;
-        cap++;
-    }
-    return cap;
+    return pool->size;
 }
 
 char* pool_at(pool_t* pool, int idx) {
-    blob_t *p = pool->head;
-    while (p && idx--) {
-        p = p->next;
-    }
-    return p ? p->data : NULL;
+    return idx >= 0 && idx < pool->size ? pool->blob[idx].data : NULL;
 }
 
 blob_t* pool_nin(pool_t* pool, const char* ptr) {
-    blob_t *p = pool->head;
-    while (p) {
-        if(p->data + sizeof(uint32_t) * 3 == ptr) {
-            break;
-        }
-        p = p->next;
+    if (!ptr) {
+        return NULL;
     }
-    return p;
+    uint32_t idx = pool_nidx(ptr);
+    if (idx < (uint32_t)pool->size && pool->blob[idx].data + POOL_NHDR == ptr) {
+        return &pool->blob[idx];
+    }
+    return NULL;
 }
 
 char* pool_nat(pool_t* pool, int idx) {
-    blob_t *p = pool->head;
-    while (p && idx--) {
-        p = p->next;
-    }
-    return p ? p->data + sizeof(uint32_t) * 3 : NULL;
+    return idx >= 0 && idx < pool->size ? pool->blob[idx].data + POOL_NHDR : NULL;
 }
 
 blob_t* pool_nget(pool_t* pool, const char* ptr, uint32_t* align, uint32_t* size, uint32_t* capacity) {
     blob_t *p = pool_nin(pool, ptr);
     if (p) {
-        *align = *(uint32_t*)p->data;
-        *size = *(uint32_t*)(p->data + sizeof(uint32_t));
-        *capacity = *(uint32_t*)(p->data + sizeof(uint32_t) * 2);
+        *align = pool_nalign(ptr);
+        *size = pool_nsize(ptr);
+        *capacity = pool_ncap(ptr);
     } else {
         *align = 0;
         *size = 0;
@@ -323,20 +781,21 @@ blob_t* pool_nget(pool_t* pool, const char* ptr, uint32_t* align, uint32_t* size
 blob_t* pool_nset(pool_t* pool, const char* ptr, uint32_t align, uint32_t size, uint32_t capacity) {
     blob_t *p = pool_nin(pool, ptr);
     if (p) {
-        *(uint32_t*)p->data = align;
-        *(uint32_t*)(p->data + sizeof(uint32_t)) = size;
-        *(uint32_t*)(p->data + sizeof(uint32_t) * 2) = capacity;
+        pool_nalign(ptr) = align;
+        pool_nsize(ptr) = size;
+        pool_ncap(ptr) = capacity;
     }
     return p;
 }
     
 
 char* pool_nalc(pool_t *pool, int align, int size) {
-    char* data = pool_alc(pool, sizeof(uint32_t) * 3 + align * size);
-    *(uint32_t*)data = align;                                   // Align (Byte)
-    *(uint32_t*)(data + sizeof(uint32_t)) = 0;                  // Size (Number)
-    *(uint32_t*)(data + sizeof(uint32_t) * 2) = size;           // Capacity (Number)
-    return data + sizeof(uint32_t) * 3;
+    char* data = pool_alc(pool, POOL_NHDR + align * size) + POOL_NHDR;
+    pool_nidx(data) = pool->size - 1;                           // Index
+    pool_nalign(data) = align;                                  // Align (Byte)
+    pool_nsize(data) = 0;                                       // Size (Number)
+    pool_ncap(data) = size;                                     // Capacity (Number)
+    return data;
 }
 
 char* pool_nrlc(pool_t* pool, char** pptr, int size) {
@@ -347,23 +806,19 @@ char* pool_nrlc(pool_t* pool, char** pptr, int size) {
     if (!p) {
         return NULL;
     }
-    // Deal with realloc
-    if (org_size < size && org_capacity < size) {
-        // realloc blob & update size & capacity & memcpy
-        char* new_data = (char*)malloc(sizeof(uint32_t) * 3 + align * size);
-        memcpy(new_data + sizeof(uint32_t) * 3, p->data + sizeof(uint32_t) * 3, align * org_size);
-        pool_nset(pool, new_data, align, org_size, size);
-        free(p->data);
-        p->data = new_data;
-        *pptr = new_data + sizeof(uint32_t) * 3;
-        return *pptr;
-    } else if (org_size < size && org_capacity >= size) {
-        // update size
-        pool_nset(pool, *pptr, align, org_size, org_capacity);
-        return *pptr;
-    } else {
-        return *pptr;
+    // Grow in place, the header moves along with the data
+    if (org_capacity < (uint32_t)size) {
+        if (pool->arena) {
+            char* data = (char*)arena_alc(pool->arena, POOL_NHDR + align * size, false);
+            memcpy(data, p->data, POOL_NHDR + align * org_size);
+            p->data = data;
+        } else {
+            p->data = (char*)realloc(p->data, POOL_NHDR + align * size);
+        }
+        *pptr = p->data + POOL_NHDR;
+        pool_ncap(*pptr) = size;
     }
+    return *pptr;
 }
 
 char* pool_npush(pool_t* pool, char** pptr, char* new, int size) {
@@ -374,23 +829,19 @@ char* pool_npush(pool_t* pool, char** pptr, char* new, int size) {
     if (!p) {
         return NULL;
     }
-    // Deal with push
-    if (org_size + size <= org_capacity) {
-        // memcpy & update size
-        memcpy(p->data + sizeof(uint32_t) * 3 + align * org_size, new, align * size);
-        pool_nset(pool, *pptr, align, org_size + size, org_capacity);
-        return p->data + sizeof(uint32_t) * 3 + align * org_size;
-    } else {
-        // expand double capacity is not enough, calculate new capacity
-        int new_capacity = org_capacity;
+    // Expand: double capacity until it fits
+    if (org_size + size > org_capacity) {
+        uint32_t new_capacity = org_capacity ? org_capacity : 1;
         while (new_capacity < org_size + size) {
             new_capacity *= 2;
         }
-        char* new_ptr = pool_nrlc(pool, pptr, new_capacity);
-        memcpy(new_ptr + align * org_size, new, align * size);
-        pool_nset(pool, new_ptr, align, org_size + size, new_capacity);
-        return new_ptr + align * org_size;
+        pool_nrlc(pool, pptr, new_capacity);
     }
+    // memcpy & update size
+    char* dst = *pptr + align * org_size;
+    memcpy(dst, new, align * size);
+    pool_nsize(*pptr) = org_size + size;
+    return dst;
 }
 
 
@@ -403,12 +854,25 @@ char* pool_npop(pool_t* pool, const char* ptr, int size) {
         return NULL;
     }
     // Deal with pop
-    if (org_size >= size) {
+    if (org_size >= (uint32_t)size) {
         // update size
-        pool_nset(pool, ptr, align, org_size - size, org_capacity);
-        return p->data + sizeof(uint32_t) * 3 + align * (org_size - size);
+        pool_nsize(ptr) = org_size - size;
+        return p->data + POOL_NHDR + align * (org_size - size);
     } else {
         return NULL;
     }
 }
 
+// Blobs [from, size) take the place of [at, at + num_del), which are dropped
+void pool_nsplice(pool_t* pool, int at, int num_del, int from) {
+    int num_new = pool->size - from;
+    for (int i = at; !pool->arena && i < at + num_del; i++) {
+        free(pool->blob[i].data);
+    }
+    pool->size = xoc_splice(pool->blob, sizeof(blob_t), at, num_del, from, pool->size);
+    // Blobs past the replaced ones only move when the count changes
+    int end = num_new == num_del ? at + num_new : pool->size;
+    for (int i = at; i < end; i++) {
+        pool_nidx(pool->blob[i].data + POOL_NHDR) = i;
+    }
+}
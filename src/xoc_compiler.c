@@ -1,5 +1,6 @@
 #include <xoc_compiler.h>
 #include <stdio.h>
+#include <string.h>
 
 void compiler_init(compiler_t* cp, const char* file, const char* src, compiler_option_t* opt) {
 
@@ -7,12 +8,27 @@ void compiler_init(compiler_t* cp, const char* file, const char* src, compiler_o
     // -- Init components
     info_init   (&cp->info, file ? file : "main", src ? src : "main", 1, 1, 0);
     log_init    (&cp->log, &cp->info, log_fn_info);
-    pool_init   (&cp->idts);
-    pool_init   (&cp->blks);
-    map_init    (&cp->sym_tbl);
-    map_add     (&cp->sym_tbl, "main", 5);
-    lexer_init  (&cp->lex, src, false, &cp->idts, &cp->sym_tbl, &cp->info, &cp->log);
-    parser_init (&cp->prs, &cp->lex, &cp->blks, &cp->idts, &cp->sym_tbl);
+    arena_init  (&cp->arena, XOC_MIN_MEM_ARENA);
+    pool_init   (&cp->idts, &cp->arena);
+    pool_init   (&cp->blks, &cp->arena);
+    intern_init (&cp->sym_tbl);
+    intern_init (&cp->str_tbl);
+    typetbl_init(&cp->type_tbl, &cp->arena);
+    intern_add  (&cp->sym_tbl, "main", 4);
+    if (!src && file && strcmp(file, "-") == 0) {
+        lexer_init_stream(&cp->lex, lexer_read_file, stdin, false, &cp->sym_tbl, &cp->info, &cp->log);
+    } else if (!src && file) {
+        lexer_init_file(&cp->lex, file, false, &cp->sym_tbl, &cp->info, &cp->log);
+    } else {
+        lexer_init(&cp->lex, src, false, &cp->sym_tbl, &cp->info, &cp->log);
+    }
+    tokbuf_init (&cp->toks);
+    if (opt->is_pretok_enabled) {
+        lexer_tokenize(&cp->lex, &cp->toks);
+    }
+    parser_init (&cp->prs, &cp->lex, &cp->blks, &cp->idts, &cp->sym_tbl, &cp->str_tbl, &cp->type_tbl);
+    memset      (&cp->gen, 0, sizeof(gen_t));
+    memset      (&cp->prog, 0, sizeof(prog_t));
 
     // -- Init compiler options
     cp->opt = *opt;
@@ -21,15 +37,56 @@ void compiler_init(compiler_t* cp, const char* file, const char* src, compiler_o
 
 
 
+// Generate code for the parsed module: 0 on success, -1 when it cannot be
+// lowered, with `prog` left empty
+int compiler_gen(compiler_t* cp) {
+    // 1. Passes over parsed blocks
+    gen_init    (&cp->gen, &cp->prs);
+    gen_typed   (&cp->gen);
+    gen_fold    (&cp->gen);
+    // 2. Bytecode
+    if (gen_lower(&cp->gen, &cp->prog) < 0) {
+        cp->log.fmt(&cp->info, "Code generation failed");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+// Apply an editor change to a module parsed with parser_module over a
+// pre-tokenized source. Only the touched tokens are relexed and the touched
+// units reparsed; code generated before the edit is dropped. The source,
+// tokens and units past the edit are left in place, see lexer_edit and
+// parser_edit.
+void compiler_edit(compiler_t* cp, int off, int num_del, const char* ins, int num_ins) {
+    int num_old, num_new;
+    int lo = lexer_edit(&cp->lex, off, num_del, ins, num_ins, &num_old, &num_new);
+    if (lo < 0) {
+        return;
+    }
+    parser_edit (&cp->prs, lo, num_old, num_new);
+    gen_free    (&cp->gen);
+    prog_free   (&cp->prog);
+}
+
+
+
 void compiler_free(compiler_t* cp) {
     // 1. Free all
     // -- Free components
     parser_free (&cp->prs);
+    gen_free    (&cp->gen);
+    prog_free   (&cp->prog);
     lexer_free  (&cp->lex);
-    map_free    (&cp->sym_tbl);
+    tokbuf_free (&cp->toks);
+    intern_free (&cp->sym_tbl);
+    intern_free (&cp->str_tbl);
+    typetbl_free(&cp->type_tbl);
     pool_free   (&cp->blks);
     pool_free   (&cp->idts);
     info_free   (&cp->info);
+    arena_free  (&cp->arena);
 }
 
 
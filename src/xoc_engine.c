@@ -2,6 +2,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 
 void heap_init(heap_t* heap);
@@ -199,6 +201,10 @@ void fiber_init(fiber_t* fib, engine_t* eng, int stack_size) {
     fib->stk = (arg_t*)heap_alc_chk(&eng->heap, stack_size * sizeof(arg_t), true);
     fib->stk_top = fib->stk_base = fib->stk + stack_size;
     fib->stk_size = stack_size;
+    fib->pc = 0;
+    fib->code = NULL;
+    fib->konst = NULL;
+    memset(fib->reg, 0, sizeof(fib->reg));
     fib->is_alive = true;
 }
 
@@ -239,12 +245,94 @@ void fiber_info(fiber_t* fib, char* buf, int len) {
 }
 
 
-void fiber_fn_push(fiber_t* fib) {
+static void fiber_fn_real(fiber_t* fib) {
+    fib->stk_top[0].F64 = (double)fib->stk_top[0].I64;
+}
+
+static void fiber_fn_real_lhs(fiber_t* fib) {
+    fib->stk_top[1].F64 = (double)fib->stk_top[1].I64;
+}
+
+static void fiber_fn_round(fiber_t* fib) {
+    fib->stk_top[0].I64 = (int64_t)round(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_trunc(fiber_t* fib) {
+    fib->stk_top[0].I64 = (int64_t)trunc(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_ceil(fiber_t* fib) {
+    fib->stk_top[0].I64 = (int64_t)ceil(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_floor(fiber_t* fib) {
+    fib->stk_top[0].I64 = (int64_t)floor(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_abs(fiber_t* fib) {
+    fib->stk_top[0].I64 = llabs(fib->stk_top[0].I64);
+}
+
+static void fiber_fn_fabs(fiber_t* fib) {
+    fib->stk_top[0].F64 = fabs(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_sqrt(fiber_t* fib) {
+    fib->stk_top[0].F64 = sqrt(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_sin(fiber_t* fib) {
+    fib->stk_top[0].F64 = sin(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_cos(fiber_t* fib) {
+    fib->stk_top[0].F64 = cos(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_atan(fiber_t* fib) {
+    fib->stk_top[0].F64 = atan(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_atan2(fiber_t* fib) {
+    double x = (fib->stk_top++)->F64;
+    fib->stk_top[0].F64 = atan2(fib->stk_top[0].F64, x);
+}
+
+static void fiber_fn_exp(fiber_t* fib) {
+    fib->stk_top[0].F64 = exp(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_log(fiber_t* fib) {
+    fib->stk_top[0].F64 = log(fib->stk_top[0].F64);
+}
+
+static void fiber_fn_memusage(fiber_t* fib) {
+    (--fib->stk_top)->I64 = fib->eng->heap.size;
+}
+
+static void fiber_fn_exit(fiber_t* fib) {
+    fib->is_alive = false;
 }
 
 
 static sysfn_t fiber_fn_tbl[] = {
-    [XOC_OP_PUSH] = fiber_fn_push,
+    [XOC_SYSFN_REAL]        = fiber_fn_real,
+    [XOC_SYSFN_REAL_LHS]    = fiber_fn_real_lhs,
+    [XOC_SYSFN_ROUND]       = fiber_fn_round,
+    [XOC_SYSFN_TRUNC]       = fiber_fn_trunc,
+    [XOC_SYSFN_CEIL]        = fiber_fn_ceil,
+    [XOC_SYSFN_FLOOR]       = fiber_fn_floor,
+    [XOC_SYSFN_ABS]         = fiber_fn_abs,
+    [XOC_SYSFN_FABS]        = fiber_fn_fabs,
+    [XOC_SYSFN_SQRT]        = fiber_fn_sqrt,
+    [XOC_SYSFN_SIN]         = fiber_fn_sin,
+    [XOC_SYSFN_COS]         = fiber_fn_cos,
+    [XOC_SYSFN_ATAN]        = fiber_fn_atan,
+    [XOC_SYSFN_ATAN2]       = fiber_fn_atan2,
+    [XOC_SYSFN_EXP]         = fiber_fn_exp,
+    [XOC_SYSFN_LOG]         = fiber_fn_log,
+    [XOC_SYSFN_MEMUSAGE]    = fiber_fn_memusage,
+    [XOC_SYSFN_EXIT]        = fiber_fn_exit,
 };
 
 
@@ -254,9 +342,11 @@ void engine_init(engine_t* eng, int stack_size, bool is_filesys_enabled, log_t*
     fiber_init(eng->fibs, eng, stack_size);
     eng->heap.src = eng->fib_cur = eng->fibs;
     eng->log = log;
-    char buf[256];
-    fiber_info(eng->fibs, buf, 256);
-    eng->log->fmt(NULL, "%s", buf);
+    if (log_on(eng->log, XOC_LOG_ENGINE, XOC_LOG_DEBUG)) {
+        char buf[256];
+        fiber_info(eng->fibs, buf, 256);
+        eng->log->fmt(NULL, "%s", buf);
+    }
 }
 
 void engine_free(engine_t* eng) {
@@ -271,27 +361,634 @@ void engine_free(engine_t* eng) {
 void engine_reset(engine_t* eng) {
     eng->fib_cur = eng->fibs;
     eng->fib_cur->stk_top = eng->fib_cur->stk_base = eng->fib_cur->stk + eng->fib_cur->stk_size;
+    eng->fib_cur->pc = 0;
+    eng->fib_cur->is_alive = true;
 }
 
 void engine_halt(engine_t* eng) {
-    
+    eng->fib_cur->is_alive = false;
+}
+
+
+// Slot domain of a generic operand, packed two bits per operand in `mode`
+static const typekind_t engine_dom_tbl[] = {
+    [XOC_DOM_I64]   = XOC_TYPE_I64,
+    [XOC_DOM_U64]   = XOC_TYPE_U64,
+    [XOC_DOM_F64]   = XOC_TYPE_F64,
+    [XOC_DOM_STR]   = XOC_TYPE_STR,
+};
+
+static inline typekind_t engine_promote(typekind_t lhs, typekind_t rhs) {
+    if (lhs == XOC_TYPE_F32 || lhs == XOC_TYPE_F64 || rhs == XOC_TYPE_F32 || rhs == XOC_TYPE_F64) {
+        return XOC_TYPE_F64;
+    }
+    if ((lhs >= XOC_TYPE_U8 && lhs <= XOC_TYPE_U64) || (rhs >= XOC_TYPE_U8 && rhs <= XOC_TYPE_U64)) {
+        return XOC_TYPE_U64;
+    }
+    return XOC_TYPE_I64;
+}
+
+// Strings compare by contents; a slot that holds none only equals another
+// that holds none. False for any other operator.
+static inline bool engine_strcmp(arg_t* dst, tokenkind_t tk, const char* lhs, const char* rhs) {
+    int cmp = lhs && rhs ? strcmp(lhs, rhs) : (lhs != NULL) - (rhs != NULL);
+    switch (tk) {
+        case XOC_TOK_EQEQ:      dst->I64 = cmp == 0;    return true;
+        case XOC_TOK_NOTEQ:     dst->I64 = cmp != 0;    return true;
+        case XOC_TOK_LESS:      dst->I64 = cmp < 0;     return true;
+        case XOC_TOK_LESSEQ:    dst->I64 = cmp <= 0;    return true;
+        case XOC_TOK_GREATER:   dst->I64 = cmp > 0;     return true;
+        case XOC_TOK_GREATEREQ: dst->I64 = cmp >= 0;    return true;
+        default:                return false;
+    }
+}
+
+static inline int64_t engine_toi64(arg_t* val, typekind_t kind) {
+    switch (kind) {
+        case XOC_TYPE_I8:   return val->I8;
+        case XOC_TYPE_I16:  return val->I16;
+        case XOC_TYPE_I32:  return val->I32;
+        case XOC_TYPE_U8:   return val->U8;
+        case XOC_TYPE_U16:  return val->U16;
+        case XOC_TYPE_U32:  return val->U32;
+        case XOC_TYPE_F32:  return (int64_t)val->F32;
+        case XOC_TYPE_F64:  return (int64_t)val->F64;
+        default:            return val->I64;
+    }
+}
+
+static inline double engine_tof64(arg_t* val, typekind_t kind) {
+    switch (kind) {
+        case XOC_TYPE_F32:  return val->F32;
+        case XOC_TYPE_F64:  return val->F64;
+        case XOC_TYPE_U64:  return (double)val->U64;
+        default:            return (double)engine_toi64(val, kind);
+    }
+}
+
+static inline void engine_load(arg_t* dst, void* ptr, typekind_t kind) {
+    switch (kind) {
+        case XOC_TYPE_I8:   dst->I64 = *(int8_t*)ptr;   break;
+        case XOC_TYPE_I16:  dst->I64 = *(int16_t*)ptr;  break;
+        case XOC_TYPE_I32:  dst->I64 = *(int32_t*)ptr;  break;
+        case XOC_TYPE_U8:
+        case XOC_TYPE_BOOL:
+        case XOC_TYPE_CHAR: dst->U64 = *(uint8_t*)ptr;  break;
+        case XOC_TYPE_U16:  dst->U64 = *(uint16_t*)ptr; break;
+        case XOC_TYPE_U32:  dst->U64 = *(uint32_t*)ptr; break;
+        case XOC_TYPE_F32:  dst->F64 = *(float*)ptr;    break;
+        default:            dst->U64 = *(uint64_t*)ptr; break;
+    }
+}
+
+bool engine_unary(arg_t* dst, tokenkind_t tk, typekind_t kind, arg_t* val) {
+    if (kind == XOC_TYPE_F32 || kind == XOC_TYPE_F64) {
+        double v = engine_tof64(val, kind);
+        switch (tk) {
+            case XOC_TOK_PLUS:  dst->F64 = v;   return true;
+            case XOC_TOK_MINUS: dst->F64 = -v;  return true;
+            case XOC_TOK_NOT:   dst->I64 = !v;  return true;
+            default:            return false;
+        }
+    }
+    int64_t v = engine_toi64(val, kind);
+    switch (tk) {
+        case XOC_TOK_PLUS:  dst->I64 = v;                           return true;
+        case XOC_TOK_MINUS: dst->U64 = 0 - (uint64_t)v;             return true;
+        case XOC_TOK_NOT:   dst->I64 = !v;                          return true;
+        case XOC_TOK_XOR:   dst->I64 = ~v;                          return true;
+        case XOC_TOK_AND:   dst->Ptr = val;                         return true;
+        default:            return false;
+    }
+}
+
+bool engine_binary(arg_t* dst, tokenkind_t tk, typekind_t lkind, arg_t* lhs, typekind_t rkind, arg_t* rhs) {
+    if (lkind == XOC_TYPE_STR && rkind == XOC_TYPE_STR && engine_strcmp(dst, tk, (const char*)lhs->Ptr, (const char*)rhs->Ptr)) {
+        return true;
+    }
+    typekind_t kind = engine_promote(lkind, rkind);
+    if (kind == XOC_TYPE_F64) {
+        double l = engine_tof64(lhs, lkind), r = engine_tof64(rhs, rkind);
+        switch (tk) {
+            case XOC_TOK_PLUS:      dst->F64 = l + r;   return true;
+            case XOC_TOK_MINUS:     dst->F64 = l - r;   return true;
+            case XOC_TOK_MUL:       dst->F64 = l * r;   return true;
+            case XOC_TOK_DIV:       dst->F64 = l / r;   return true;
+            case XOC_TOK_EQEQ:      dst->I64 = l == r;  return true;
+            case XOC_TOK_NOTEQ:     dst->I64 = l != r;  return true;
+            case XOC_TOK_LESS:      dst->I64 = l < r;   return true;
+            case XOC_TOK_LESSEQ:    dst->I64 = l <= r;  return true;
+            case XOC_TOK_GREATER:   dst->I64 = l > r;   return true;
+            case XOC_TOK_GREATEREQ: dst->I64 = l >= r;  return true;
+            case XOC_TOK_ANDAND:    dst->I64 = l && r;  return true;
+            case XOC_TOK_OROR:      dst->I64 = l || r;  return true;
+            default:                return false;
+        }
+    }
+    uint64_t l = engine_toi64(lhs, lkind), r = engine_toi64(rhs, rkind);
+    bool is_signed = kind == XOC_TYPE_I64;
+    switch (tk) {
+        case XOC_TOK_PLUS:      dst->U64 = l + r;   return true;
+        case XOC_TOK_MINUS:     dst->U64 = l - r;   return true;
+        case XOC_TOK_MUL:       dst->U64 = l * r;   return true;
+        case XOC_TOK_DIV:
+        case XOC_TOK_MOD:
+            if (r == 0 || (is_signed && (int64_t)l == INT64_MIN && (int64_t)r == -1)) {
+                return false;
+            }
+            if (tk == XOC_TOK_DIV) {
+                dst->U64 = is_signed ? (uint64_t)((int64_t)l / (int64_t)r) : l / r;
+            } else {
+                dst->U64 = is_signed ? (uint64_t)((int64_t)l % (int64_t)r) : l % r;
+            }
+            return true;
+        case XOC_TOK_AND:       dst->U64 = l & r;   return true;
+        case XOC_TOK_OR:        dst->U64 = l | r;   return true;
+        case XOC_TOK_XOR:       dst->U64 = l ^ r;   return true;
+        case XOC_TOK_SHL:       dst->U64 = r < 64 ? l << r : 0; return true;
+        case XOC_TOK_SHR:       dst->U64 = r < 64 ? (is_signed ? (uint64_t)((int64_t)l >> r) : l >> r) : 0; return true;
+        case XOC_TOK_EQEQ:      dst->I64 = l == r;  return true;
+        case XOC_TOK_NOTEQ:     dst->I64 = l != r;  return true;
+        case XOC_TOK_LESS:      dst->I64 = is_signed ? (int64_t)l <  (int64_t)r : l <  r; return true;
+        case XOC_TOK_LESSEQ:    dst->I64 = is_signed ? (int64_t)l <= (int64_t)r : l <= r; return true;
+        case XOC_TOK_GREATER:   dst->I64 = is_signed ? (int64_t)l >  (int64_t)r : l >  r; return true;
+        case XOC_TOK_GREATEREQ: dst->I64 = is_signed ? (int64_t)l >= (int64_t)r : l >= r; return true;
+        case XOC_TOK_ANDAND:    dst->I64 = l && r;  return true;
+        case XOC_TOK_OROR:      dst->I64 = l || r;  return true;
+        default:                return false;
+    }
+}
+
+static void engine_change_ref_cnt(heap_t* heap, void* ptr, int delta) {
+    heappage_t* page = heap_find(heap, (char*)ptr);
+    if (page) {
+        heap_change_chk_ref_cnt(heap, page, (char*)ptr, delta);
+    }
 }
 
-void engine_loop(engine_t* eng) {
+
+// Dispatch: threaded code (computed goto) on GNU-compatible compilers,
+// plain switch otherwise. Build with -DXOC_ENGINE_THREADED=0 to force the switch.
+#ifndef XOC_ENGINE_THREADED
+#   if defined(__GNUC__) || defined(__clang__)
+#       define XOC_ENGINE_THREADED 1
+#   else
+#       define XOC_ENGINE_THREADED 0
+#   endif
+#endif
+
+#if XOC_ENGINE_THREADED
+#   define ENGINE_OP(op)        L_##op:
+#   define ENGINE_DISPATCH()    goto *engine_label_tbl[code[pc].opc]
+#   define ENGINE_NEXT()        do { pc++; ENGINE_DISPATCH(); } while (0)
+#   define ENGINE_JUMP(to)      do { pc = (to); ENGINE_DISPATCH(); } while (0)
+#else
+#   define ENGINE_OP(op)        case op:
+#   define ENGINE_DISPATCH()    continue
+// `continue` must reach the dispatch loop, so no do/while(0) wrapper here
+#   define ENGINE_NEXT()        if (1) { pc++; continue; } else (void)0
+#   define ENGINE_JUMP(to)      if (1) { pc = (to); continue; } else (void)0
+#endif
+
+#define ENGINE_ERROR(...)       do { log->fmt(NULL, __VA_ARGS__); status = ENGINE_STATUS_ERROR; goto engine_exit; } while (0)
+#define ENGINE_A                (&base[-1 - (int64_t)code[pc].a])
+#define ENGINE_B                (&base[-1 - (int64_t)code[pc].b])
+#define ENGINE_C                (&base[-1 - (int64_t)code[pc].c])
+#define ENGINE_IMM              (code[pc].imm)
+#define ENGINE_DOM_B            engine_dom_tbl[code[pc].mode & 3]
+#define ENGINE_DOM_C            engine_dom_tbl[(code[pc].mode >> 2) & 3]
+#define ENGINE_UNOP(op, F, expr)    ENGINE_OP(op) { arg_t* v = ENGINE_B; ENGINE_A->F = (expr); ENGINE_NEXT(); }
+#define ENGINE_BINOP(op, F, expr)   ENGINE_OP(op) { arg_t* l = ENGINE_B; arg_t* r = ENGINE_C; ENGINE_A->F = (expr); ENGINE_NEXT(); }
+
+engine_status_t engine_loop(engine_t* eng) {
     fiber_t* fib = eng->fib_cur;
     heap_t* heap = &eng->heap;
     log_t*   log = eng->log;
 
-    while(1) {
-        if(fib->stk_top - fib->stk < XOC_MIN_MEM_STACK) {
-            log->fmt(NULL, "Stack overflow %ld/%d", fib->stk_top - fib->stk, fib->stk_size);
-            break;
+    // Hot state lives in locals and is written back on exit
+    code_t*  code = fib->code;
+    int64_t    pc = fib->pc;
+    arg_t*    top = fib->stk_top;
+    arg_t*   base = fib->stk_base;
+    arg_t*    stk = fib->stk;
+    engine_status_t status = ENGINE_STATUS_OK;
+
+#if XOC_ENGINE_THREADED
+    static const void* engine_label_tbl[XOC_NUM_OPCODE] = {
+        [XOC_OP_NOP]                    = &&L_XOC_OP_NOP,
+        [XOC_OP_REG]                    = &&L_XOC_OP_REG,
+        [XOC_OP_PUSH]                   = &&L_XOC_OP_PUSH,
+        [XOC_OP_PUSH_ZERO]              = &&L_XOC_OP_PUSH_ZERO,
+        [XOC_OP_PUSH_LOCAL_PTR]         = &&L_XOC_OP_PUSH_LOCAL_PTR,
+        [XOC_OP_PUSH_LOCAL_PTR_ZERO]    = &&L_XOC_OP_PUSH_LOCAL_PTR_ZERO,
+        [XOC_OP_PUSH_LOCAL]             = &&L_XOC_OP_PUSH_LOCAL,
+        [XOC_OP_PUSH_REG]               = &&L_XOC_OP_PUSH_REG,
+        [XOC_OP_PUSH_UPVALUE]           = &&L_XOC_OP_PUSH_UPVALUE,
+        [XOC_OP_POP]                    = &&L_XOC_OP_POP,
+        [XOC_OP_POP_REG]                = &&L_XOC_OP_POP_REG,
+        [XOC_OP_DUP]                    = &&L_XOC_OP_DUP,
+        [XOC_OP_SWAP]                   = &&L_XOC_OP_SWAP,
+        [XOC_OP_ZERO]                   = &&L_XOC_OP_ZERO,
+        [XOC_OP_DEREF]                  = &&L_XOC_OP_DEREF,
+        [XOC_OP_ASSIGN]                 = &&L_XOC_OP_ASSIGN,
+        [XOC_OP_ASSIGN_PARAM]           = &&L_XOC_OP_ASSIGN_PARAM,
+        [XOC_OP_CHANGE_REF_CNT]         = &&L_XOC_OP_CHANGE_REF_CNT,
+        [XOC_OP_CHANGE_REF_CNT_GLOBAL]  = &&L_XOC_OP_CHANGE_REF_CNT_GLOBAL,
+        [XOC_OP_CHANGE_REF_CNT_LOCAL]   = &&L_XOC_OP_CHANGE_REF_CNT_LOCAL,
+        [XOC_OP_CHANGE_REF_CNT_ASSIGN]  = &&L_XOC_OP_CHANGE_REF_CNT_ASSIGN,
+        [XOC_OP_UNARY]                  = &&L_XOC_OP_UNARY,
+        [XOC_OP_BINARY]                 = &&L_XOC_OP_BINARY,
+        [XOC_OP_NEG_I64]                 = &&L_XOC_OP_NEG_I64,
+        [XOC_OP_NEG_F64]                 = &&L_XOC_OP_NEG_F64,
+        [XOC_OP_NOT_I64]                 = &&L_XOC_OP_NOT_I64,
+        [XOC_OP_BNOT_I64]                = &&L_XOC_OP_BNOT_I64,
+        [XOC_OP_ADD_I64]                 = &&L_XOC_OP_ADD_I64,
+        [XOC_OP_SUB_I64]                 = &&L_XOC_OP_SUB_I64,
+        [XOC_OP_MUL_I64]                 = &&L_XOC_OP_MUL_I64,
+        [XOC_OP_DIV_I64]                 = &&L_XOC_OP_DIV_I64,
+        [XOC_OP_MOD_I64]                 = &&L_XOC_OP_MOD_I64,
+        [XOC_OP_AND_I64]                 = &&L_XOC_OP_AND_I64,
+        [XOC_OP_OR_I64]                  = &&L_XOC_OP_OR_I64,
+        [XOC_OP_XOR_I64]                 = &&L_XOC_OP_XOR_I64,
+        [XOC_OP_SHL_I64]                 = &&L_XOC_OP_SHL_I64,
+        [XOC_OP_SHR_I64]                 = &&L_XOC_OP_SHR_I64,
+        [XOC_OP_EQ_I64]                  = &&L_XOC_OP_EQ_I64,
+        [XOC_OP_NE_I64]                  = &&L_XOC_OP_NE_I64,
+        [XOC_OP_LT_I64]                  = &&L_XOC_OP_LT_I64,
+        [XOC_OP_LE_I64]                  = &&L_XOC_OP_LE_I64,
+        [XOC_OP_GT_I64]                  = &&L_XOC_OP_GT_I64,
+        [XOC_OP_GE_I64]                  = &&L_XOC_OP_GE_I64,
+        [XOC_OP_DIV_U64]                 = &&L_XOC_OP_DIV_U64,
+        [XOC_OP_MOD_U64]                 = &&L_XOC_OP_MOD_U64,
+        [XOC_OP_SHR_U64]                 = &&L_XOC_OP_SHR_U64,
+        [XOC_OP_LT_U64]                  = &&L_XOC_OP_LT_U64,
+        [XOC_OP_LE_U64]                  = &&L_XOC_OP_LE_U64,
+        [XOC_OP_GT_U64]                  = &&L_XOC_OP_GT_U64,
+        [XOC_OP_GE_U64]                  = &&L_XOC_OP_GE_U64,
+        [XOC_OP_ADD_F64]                 = &&L_XOC_OP_ADD_F64,
+        [XOC_OP_SUB_F64]                 = &&L_XOC_OP_SUB_F64,
+        [XOC_OP_MUL_F64]                 = &&L_XOC_OP_MUL_F64,
+        [XOC_OP_DIV_F64]                 = &&L_XOC_OP_DIV_F64,
+        [XOC_OP_EQ_F64]                  = &&L_XOC_OP_EQ_F64,
+        [XOC_OP_NE_F64]                  = &&L_XOC_OP_NE_F64,
+        [XOC_OP_LT_F64]                  = &&L_XOC_OP_LT_F64,
+        [XOC_OP_LE_F64]                  = &&L_XOC_OP_LE_F64,
+        [XOC_OP_GT_F64]                  = &&L_XOC_OP_GT_F64,
+        [XOC_OP_GE_F64]                  = &&L_XOC_OP_GE_F64,
+        [XOC_OP_GET_ARRAY_PTR]          = &&L_XOC_OP_GET_ARRAY_PTR,
+        [XOC_OP_GET_DYNARRAY_PTR]       = &&L_XOC_OP_GET_DYNARRAY_PTR,
+        [XOC_OP_GET_MAP_PTR]            = &&L_XOC_OP_GET_MAP_PTR,
+        [XOC_OP_GET_FIELD_PTR]          = &&L_XOC_OP_GET_FIELD_PTR,
+        [XOC_OP_ASSERT_TYPE]            = &&L_XOC_OP_ASSERT_TYPE,
+        [XOC_OP_ASSERT_RANGE]           = &&L_XOC_OP_ASSERT_RANGE,
+        [XOC_OP_WEAKEN_PTR]             = &&L_XOC_OP_WEAKEN_PTR,
+        [XOC_OP_STRENGTHEN_PTR]         = &&L_XOC_OP_STRENGTHEN_PTR,
+        [XOC_OP_JMP]                    = &&L_XOC_OP_JMP,
+        [XOC_OP_JMP_IF]                 = &&L_XOC_OP_JMP_IF,
+        [XOC_OP_JMP_IFN]                = &&L_XOC_OP_JMP_IFN,
+        [XOC_OP_JMP_IFEQ]               = &&L_XOC_OP_JMP_IFEQ,
+        [XOC_OP_JMP_IFNE]               = &&L_XOC_OP_JMP_IFNE,
+        [XOC_OP_JMP_IFLT]               = &&L_XOC_OP_JMP_IFLT,
+        [XOC_OP_JMP_TBL]                = &&L_XOC_OP_JMP_TBL,
+        [XOC_OP_JMP_HASH]               = &&L_XOC_OP_JMP_HASH,
+        [XOC_OP_CALL]                   = &&L_XOC_OP_CALL,
+        [XOC_OP_CALL_INDIRECT]          = &&L_XOC_OP_CALL_INDIRECT,
+        [XOC_OP_CALL_EXTERN]            = &&L_XOC_OP_CALL_EXTERN,
+        [XOC_OP_CALL_BUILTIN]           = &&L_XOC_OP_CALL_BUILTIN,
+        [XOC_OP_RET]                    = &&L_XOC_OP_RET,
+        [XOC_OP_ENTER_FRAME]            = &&L_XOC_OP_ENTER_FRAME,
+        [XOC_OP_LEAVE_FRAME]            = &&L_XOC_OP_LEAVE_FRAME,
+        [XOC_OP_HALT]                   = &&L_XOC_OP_HALT,
+    };
+    ENGINE_DISPATCH();
+#else
+    for (;;) switch (code[pc].opc) {
+#endif
+
+    ENGINE_OP(XOC_OP_NOP)
+    ENGINE_OP(XOC_OP_REG) {
+        // Register declarations are bound to slots by the generator
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_PUSH)
+    ENGINE_OP(XOC_OP_PUSH_LOCAL) {
+        *--top = *ENGINE_B;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_PUSH_ZERO) {
+        (--top)->U64 = 0;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_PUSH_LOCAL_PTR) {
+        (--top)->Ptr = ENGINE_B;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_PUSH_LOCAL_PTR_ZERO) {
+        arg_t* slot = ENGINE_B;
+        slot->U64 = 0;
+        (--top)->Ptr = slot;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_PUSH_REG) {
+        *--top = fib->reg[ENGINE_IMM.I64];
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_POP) {
+        top += ENGINE_IMM.I64 ? ENGINE_IMM.I64 : 1;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_POP_REG) {
+        fib->reg[ENGINE_IMM.I64] = *top++;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_DUP) {
+        top--;
+        top[0] = top[1];
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_SWAP) {
+        arg_t tmp = top[0];
+        top[0] = top[1];
+        top[1] = tmp;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_ZERO) {
+        memset((top++)->Ptr, 0, ENGINE_IMM.I64);
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_DEREF) {
+        if (!top->Ptr) {
+            ENGINE_ERROR("Pointer is null");
         }
-        switch(fib->code[fib->pc].opc) {
-            default: {
-                log->fmt(NULL, "Unknown op %d", fib->code[fib->pc].opc);
-                break;
-            }
+        engine_load(top, top->Ptr, ENGINE_IMM.I64);
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_ASSIGN) {
+        *ENGINE_A = *ENGINE_B;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_ASSIGN_PARAM) {
+        *ENGINE_A = *top++;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_CHANGE_REF_CNT) {
+        engine_change_ref_cnt(heap, top->Ptr, ENGINE_IMM.I64);
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_CHANGE_REF_CNT_GLOBAL) {
+        engine_change_ref_cnt(heap, *(void**)ENGINE_B->Ptr, ENGINE_IMM.I64);
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_CHANGE_REF_CNT_LOCAL) {
+        engine_change_ref_cnt(heap, ENGINE_B->Ptr, ENGINE_IMM.I64);
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_CHANGE_REF_CNT_ASSIGN) {
+        arg_t val = *top++;
+        void** dst = (void**)(top++)->Ptr;
+        engine_change_ref_cnt(heap, val.Ptr, 1);
+        engine_change_ref_cnt(heap, *dst, -1);
+        *dst = val.Ptr;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_UNARY) {
+        if (!engine_unary(ENGINE_A, ENGINE_IMM.I64, ENGINE_DOM_B, ENGINE_B)) {
+            ENGINE_ERROR("Illegal unary `%s`", lexer_mnemonic(ENGINE_IMM.I64));
         }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_BINARY) {
+        if (!engine_binary(ENGINE_A, ENGINE_IMM.I64, ENGINE_DOM_B, ENGINE_B, ENGINE_DOM_C, ENGINE_C)) {
+            ENGINE_ERROR("Illegal binary `%s`", lexer_mnemonic(ENGINE_IMM.I64));
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_UNOP (XOC_OP_NEG_I64,  U64, 0 - v->U64)
+    ENGINE_UNOP (XOC_OP_NEG_F64,  F64, -v->F64)
+    ENGINE_UNOP (XOC_OP_NOT_I64,  I64, !v->I64)
+    ENGINE_UNOP (XOC_OP_BNOT_I64, I64, ~v->I64)
+    ENGINE_BINOP(XOC_OP_ADD_I64,  U64, l->U64 + r->U64)
+    ENGINE_BINOP(XOC_OP_SUB_I64,  U64, l->U64 - r->U64)
+    ENGINE_BINOP(XOC_OP_MUL_I64,  U64, l->U64 * r->U64)
+    ENGINE_BINOP(XOC_OP_AND_I64,  U64, l->U64 & r->U64)
+    ENGINE_BINOP(XOC_OP_OR_I64,   U64, l->U64 | r->U64)
+    ENGINE_BINOP(XOC_OP_XOR_I64,  U64, l->U64 ^ r->U64)
+    ENGINE_BINOP(XOC_OP_SHL_I64,  U64, r->U64 < 64 ? l->U64 << r->U64 : 0)
+    ENGINE_BINOP(XOC_OP_SHR_I64,  I64, r->U64 < 64 ? l->I64 >> r->U64 : 0)
+    ENGINE_BINOP(XOC_OP_EQ_I64,   I64, l->I64 == r->I64)
+    ENGINE_BINOP(XOC_OP_NE_I64,   I64, l->I64 != r->I64)
+    ENGINE_BINOP(XOC_OP_LT_I64,   I64, l->I64 <  r->I64)
+    ENGINE_BINOP(XOC_OP_LE_I64,   I64, l->I64 <= r->I64)
+    ENGINE_BINOP(XOC_OP_GT_I64,   I64, l->I64 >  r->I64)
+    ENGINE_BINOP(XOC_OP_GE_I64,   I64, l->I64 >= r->I64)
+    ENGINE_BINOP(XOC_OP_SHR_U64,  U64, r->U64 < 64 ? l->U64 >> r->U64 : 0)
+    ENGINE_BINOP(XOC_OP_LT_U64,   I64, l->U64 <  r->U64)
+    ENGINE_BINOP(XOC_OP_LE_U64,   I64, l->U64 <= r->U64)
+    ENGINE_BINOP(XOC_OP_GT_U64,   I64, l->U64 >  r->U64)
+    ENGINE_BINOP(XOC_OP_GE_U64,   I64, l->U64 >= r->U64)
+    ENGINE_BINOP(XOC_OP_ADD_F64,  F64, l->F64 + r->F64)
+    ENGINE_BINOP(XOC_OP_SUB_F64,  F64, l->F64 - r->F64)
+    ENGINE_BINOP(XOC_OP_MUL_F64,  F64, l->F64 * r->F64)
+    ENGINE_BINOP(XOC_OP_DIV_F64,  F64, l->F64 / r->F64)
+    ENGINE_BINOP(XOC_OP_EQ_F64,   I64, l->F64 == r->F64)
+    ENGINE_BINOP(XOC_OP_NE_F64,   I64, l->F64 != r->F64)
+    ENGINE_BINOP(XOC_OP_LT_F64,   I64, l->F64 <  r->F64)
+    ENGINE_BINOP(XOC_OP_LE_F64,   I64, l->F64 <= r->F64)
+    ENGINE_BINOP(XOC_OP_GT_F64,   I64, l->F64 >  r->F64)
+    ENGINE_BINOP(XOC_OP_GE_F64,   I64, l->F64 >= r->F64)
+    ENGINE_OP(XOC_OP_DIV_I64)
+    ENGINE_OP(XOC_OP_MOD_I64) {
+        arg_t* l = ENGINE_B;
+        arg_t* r = ENGINE_C;
+        if (r->I64 == 0 || (l->I64 == INT64_MIN && r->I64 == -1)) {
+            ENGINE_ERROR("Illegal integer division");
+        }
+        ENGINE_A->I64 = code[pc].opc == XOC_OP_DIV_I64 ? l->I64 / r->I64 : l->I64 % r->I64;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_DIV_U64)
+    ENGINE_OP(XOC_OP_MOD_U64) {
+        arg_t* l = ENGINE_B;
+        arg_t* r = ENGINE_C;
+        if (r->U64 == 0) {
+            ENGINE_ERROR("Illegal integer division");
+        }
+        ENGINE_A->U64 = code[pc].opc == XOC_OP_DIV_U64 ? l->U64 / r->U64 : l->U64 % r->U64;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_GET_ARRAY_PTR) {
+        int64_t idx = (top++)->I64;
+        int64_t len = ENGINE_B->I64;
+        if (idx < 0 || idx >= len) {
+            ENGINE_ERROR("Index %ld is out of range 0...%ld", idx, len - 1);
+        }
+        top->Ptr = (char*)top->Ptr + idx * ENGINE_IMM.I64;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_GET_FIELD_PTR) {
+        if (!top->Ptr) {
+            ENGINE_ERROR("Pointer is null");
+        }
+        top->Ptr = (char*)top->Ptr + ENGINE_IMM.I64;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_ASSERT_RANGE) {
+        if (top->I64 < 0 || top->I64 >= ENGINE_IMM.I64) {
+            ENGINE_ERROR("Value %ld is out of range 0...%ld", top->I64, ENGINE_IMM.I64 - 1);
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_WEAKEN_PTR) {
+        top->WPtr = (uint64_t)(uintptr_t)top->Ptr;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_STRENGTHEN_PTR) {
+        void* ptr = (void*)(uintptr_t)top->WPtr;
+        top->Ptr = heap_find(heap, ptr) ? ptr : NULL;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_JMP) {
+        ENGINE_JUMP(ENGINE_IMM.I64);
     }
-}
\ No newline at end of file
+    ENGINE_OP(XOC_OP_JMP_IF) {
+        if (ENGINE_B->I64) {
+            ENGINE_JUMP(ENGINE_IMM.I64);
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_JMP_IFN) {
+        if (!ENGINE_B->I64) {
+            ENGINE_JUMP(ENGINE_IMM.I64);
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_JMP_IFEQ) {
+        arg_t res;
+        engine_binary(&res, XOC_TOK_EQEQ, ENGINE_DOM_B, ENGINE_B, ENGINE_DOM_C, ENGINE_C);
+        if (res.I64) {
+            ENGINE_JUMP(ENGINE_IMM.I64);
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_JMP_IFNE) {
+        arg_t res;
+        engine_binary(&res, XOC_TOK_NOTEQ, ENGINE_DOM_B, ENGINE_B, ENGINE_DOM_C, ENGINE_C);
+        if (res.I64) {
+            ENGINE_JUMP(ENGINE_IMM.I64);
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_JMP_IFLT) {
+        arg_t res;
+        engine_binary(&res, XOC_TOK_LESS, ENGINE_DOM_B, ENGINE_B, ENGINE_DOM_C, ENGINE_C);
+        if (res.I64) {
+            ENGINE_JUMP(ENGINE_IMM.I64);
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_JMP_TBL) {
+        // `c` JMPs follow for the values from `imm` on, then the default one.
+        // Values below `imm` wrap around to large indices.
+        uint64_t idx = ENGINE_B->U64 - ENGINE_IMM.U64;
+        ENGINE_JUMP(code[pc + 1 + (idx < code[pc].c ? idx : code[pc].c)].imm.I64);
+    }
+    ENGINE_OP(XOC_OP_JMP_HASH) {
+        // 2^c buckets of two codes follow, picked by the top `c` bits of the
+        // string's hash times `imm`: a compare of the contents that enters
+        // the case and a JMP that leaves for the default. No string at all
+        // takes the first bucket's JMP.
+        const char* str = (const char*)ENGINE_B->Ptr;
+        if (!str) {
+            ENGINE_JUMP(pc + 2);
+        }
+        uint64_t idx = (xoc_hashn(str, strlen(str)) * ENGINE_IMM.U64) >> (64 - code[pc].c);
+        ENGINE_JUMP(pc + 1 + 2 * idx);
+    }
+    ENGINE_OP(XOC_OP_CALL) {
+        (--top)->I64 = pc + 1;
+        ENGINE_JUMP(ENGINE_IMM.I64);
+    }
+    ENGINE_OP(XOC_OP_CALL_INDIRECT) {
+        int64_t entry = top->I64;
+        top->I64 = pc + 1;
+        ENGINE_JUMP(entry);
+    }
+    ENGINE_OP(XOC_OP_CALL_EXTERN) {
+        ((extfn_t)ENGINE_IMM.Ptr)(top, &fib->reg[XOC_REG_RESULT]);
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_CALL_BUILTIN) {
+        int64_t fn = ENGINE_IMM.I64;
+        if (fn < 0 || fn >= (int64_t)(sizeof(fiber_fn_tbl) / sizeof(fiber_fn_tbl[0])) || !fiber_fn_tbl[fn]) {
+            ENGINE_ERROR("Illegal builtin %ld", fn);
+        }
+        fib->stk_top = top;
+        fiber_fn_tbl[fn](fib);
+        top = fib->stk_top;
+        if (!fib->is_alive) {
+            goto engine_exit;
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_RET) {
+        int64_t ret = (top++)->I64;
+        top += ENGINE_IMM.I64;
+        if (ret == XOC_RET_FROM_FIB || ret == XOC_RET_FROM_ENG) {
+            goto engine_exit;
+        }
+        ENGINE_JUMP(ret);
+    }
+    ENGINE_OP(XOC_OP_ENTER_FRAME) {
+        // Overflow is only possible when a frame is entered: pushes inside
+        // the frame stay within the red zone reserved here
+        // Constants are copied into the top `c` slots starting at `b`, so every
+        // operand is addressed the same way
+        int64_t size = ENGINE_IMM.I64;
+        if (top - stk < size + 1 + XOC_MIN_STK_REDZONE) {
+            ENGINE_ERROR("Stack overflow %ld/%d", fib->stk + fib->stk_size - top, fib->stk_size);
+        }
+        (--top)->Ptr = base;
+        base = top;
+        top -= size;
+        memset(top, 0, size * sizeof(arg_t));
+        for (int i = 0; i < code[pc].c; i++) {
+            base[-1 - (int64_t)code[pc].b - i] = fib->konst[i];
+        }
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_LEAVE_FRAME) {
+        top = base;
+        base = (top++)->Ptr;
+        ENGINE_NEXT();
+    }
+    ENGINE_OP(XOC_OP_HALT) {
+        fib->is_alive = false;
+        goto engine_exit;
+    }
+    ENGINE_OP(XOC_OP_PUSH_UPVALUE)
+    ENGINE_OP(XOC_OP_GET_DYNARRAY_PTR)
+    ENGINE_OP(XOC_OP_GET_MAP_PTR)
+    ENGINE_OP(XOC_OP_ASSERT_TYPE) {
+        ENGINE_ERROR("Unsupported op %d", code[pc].opc);
+    }
+
+#if !XOC_ENGINE_THREADED
+    default:
+        ENGINE_ERROR("Unknown op %d", code[pc].opc);
+    }
+#endif
+
+engine_exit:
+    fib->pc = pc;
+    fib->stk_top = top;
+    fib->stk_base = base;
+    return status;
+}
+
+
+engine_status_t engine_run(engine_t* eng, prog_t* prog) {
+    engine_reset(eng);
+    eng->fib_cur->code = prog->code;
+    eng->fib_cur->konst = prog->konst;
+    return engine_loop(eng);
+}
@@ -0,0 +1,942 @@
+#include <xoc_gen.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+
+void gen_init(gen_t* gen, parser_t* prs) {
+    gen->size = prs->tid;
+    gen->pid = 0;
+    gen->tmp_kind = (typekind_t*)calloc(gen->size > 0 ? gen->size : 1, sizeof(typekind_t));
+    gen->tmp_val = NULL;
+    gen->key_val = NULL;
+    gen->num_key = 0;
+    gen->sym_slot = NULL;
+    gen->num_sym = 0;
+    gen->num_fold = 0;
+    memset(gen->num_switch, 0, sizeof(gen->num_switch));
+    gen->prs = prs;
+    gen->log = prs->log;
+}
+
+void gen_free(gen_t* gen) {
+    free(gen->tmp_kind);
+    free(gen->tmp_val);
+    free(gen->key_val);
+    free(gen->sym_slot);
+    gen->tmp_kind = NULL;
+    gen->tmp_val = NULL;
+    gen->key_val = NULL;
+    gen->sym_slot = NULL;
+    gen->num_key = 0;
+    gen->num_sym = 0;
+}
+
+// Value kind of an operand as the engine sees it: every integer lives widened
+// in a 64-bit slot, so only I64/U64/F64 are distinguished. NONE means unknown.
+static typekind_t gen_kind(gen_t* gen, type_t* opr) {
+    switch (opr->kind) {
+        case XOC_TYPE_I64:
+        case XOC_TYPE_CHAR:
+        case XOC_TYPE_BOOL: return XOC_TYPE_I64;
+        case XOC_TYPE_U64:  return XOC_TYPE_U64;
+        case XOC_TYPE_F64:  return XOC_TYPE_F64;
+        case XOC_TYPE_TMP:  return opr->val.WPtr < (uint64_t)gen->size ? gen->tmp_kind[opr->val.WPtr] : XOC_TYPE_NONE;
+        default:            return XOC_TYPE_NONE;
+    }
+}
+
+// Mirror of the engine's generic promotion: float wins, then unsigned
+static typekind_t gen_promote(typekind_t lhs, typekind_t rhs) {
+    if (lhs == XOC_TYPE_NONE || rhs == XOC_TYPE_NONE) {
+        return XOC_TYPE_NONE;
+    }
+    if (lhs == XOC_TYPE_F64 || rhs == XOC_TYPE_F64) {
+        return XOC_TYPE_F64;
+    }
+    if (lhs == XOC_TYPE_U64 || rhs == XOC_TYPE_U64) {
+        return XOC_TYPE_U64;
+    }
+    return XOC_TYPE_I64;
+}
+
+static opcode_t gen_unary_op(tokenkind_t tk, typekind_t kind) {
+    switch (tk) {
+        case XOC_TOK_MINUS: return kind == XOC_TYPE_F64 ? XOC_OP_NEG_F64 : XOC_OP_NEG_I64;
+        case XOC_TOK_NOT:   return kind == XOC_TYPE_F64 ? XOC_OP_UNARY : XOC_OP_NOT_I64;
+        case XOC_TOK_XOR:   return kind == XOC_TYPE_F64 ? XOC_OP_UNARY : XOC_OP_BNOT_I64;
+        default:            return XOC_OP_UNARY;
+    }
+}
+
+static opcode_t gen_binary_op(tokenkind_t tk, typekind_t kind) {
+    if (kind == XOC_TYPE_F64) {
+        switch (tk) {
+            case XOC_TOK_PLUS:      return XOC_OP_ADD_F64;
+            case XOC_TOK_MINUS:     return XOC_OP_SUB_F64;
+            case XOC_TOK_MUL:       return XOC_OP_MUL_F64;
+            case XOC_TOK_DIV:       return XOC_OP_DIV_F64;
+            case XOC_TOK_EQEQ:      return XOC_OP_EQ_F64;
+            case XOC_TOK_NOTEQ:     return XOC_OP_NE_F64;
+            case XOC_TOK_LESS:      return XOC_OP_LT_F64;
+            case XOC_TOK_LESSEQ:    return XOC_OP_LE_F64;
+            case XOC_TOK_GREATER:   return XOC_OP_GT_F64;
+            case XOC_TOK_GREATEREQ: return XOC_OP_GE_F64;
+            default:                return XOC_OP_BINARY;
+        }
+    }
+    bool is_unsigned = kind == XOC_TYPE_U64;
+    switch (tk) {
+        case XOC_TOK_PLUS:      return XOC_OP_ADD_I64;
+        case XOC_TOK_MINUS:     return XOC_OP_SUB_I64;
+        case XOC_TOK_MUL:       return XOC_OP_MUL_I64;
+        case XOC_TOK_DIV:       return is_unsigned ? XOC_OP_DIV_U64 : XOC_OP_DIV_I64;
+        case XOC_TOK_MOD:       return is_unsigned ? XOC_OP_MOD_U64 : XOC_OP_MOD_I64;
+        case XOC_TOK_AND:       return XOC_OP_AND_I64;
+        case XOC_TOK_OR:        return XOC_OP_OR_I64;
+        case XOC_TOK_XOR:       return XOC_OP_XOR_I64;
+        case XOC_TOK_SHL:       return XOC_OP_SHL_I64;
+        case XOC_TOK_SHR:       return is_unsigned ? XOC_OP_SHR_U64 : XOC_OP_SHR_I64;
+        case XOC_TOK_EQEQ:      return XOC_OP_EQ_I64;
+        case XOC_TOK_NOTEQ:     return XOC_OP_NE_I64;
+        case XOC_TOK_LESS:      return is_unsigned ? XOC_OP_LT_U64 : XOC_OP_LT_I64;
+        case XOC_TOK_LESSEQ:    return is_unsigned ? XOC_OP_LE_U64 : XOC_OP_LE_I64;
+        case XOC_TOK_GREATER:   return is_unsigned ? XOC_OP_GT_U64 : XOC_OP_GT_I64;
+        case XOC_TOK_GREATEREQ: return is_unsigned ? XOC_OP_GE_U64 : XOC_OP_GE_I64;
+        default:                return XOC_OP_BINARY;
+    }
+}
+
+static bool gen_is_cmp(tokenkind_t tk) {
+    return tk == XOC_TOK_EQEQ || tk == XOC_TOK_NOTEQ ||
+           tk == XOC_TOK_LESS || tk == XOC_TOK_LESSEQ ||
+           tk == XOC_TOK_GREATER || tk == XOC_TOK_GREATEREQ ||
+           tk == XOC_TOK_ANDAND || tk == XOC_TOK_OROR;
+}
+
+// Bring an operand into the domain of a typed op. Literals are converted in
+// place; anything else must already have the right kind.
+static bool gen_coerce(gen_t* gen, type_t** opr, typekind_t kind) {
+    typekind_t from = gen_kind(gen, *opr);
+    if (from == kind || (kind == XOC_TYPE_U64 && from == XOC_TYPE_I64)) {
+        return true;
+    }
+    if (kind == XOC_TYPE_F64 && from == XOC_TYPE_I64 && (*opr)->kind != XOC_TYPE_TMP) {
+        *opr = type_f64(gen->prs->types, (double)(*opr)->val.I64);
+        return true;
+    }
+    return false;
+}
+
+// Temps of known kind carry it in `base` so generic ops left over still
+// read them in the right domain
+static void gen_annotate(gen_t* gen, type_t** opr) {
+    if (!*opr || (*opr)->kind != XOC_TYPE_TMP) {
+        return;
+    }
+    typekind_t kind = gen_kind(gen, *opr);
+    if (kind == XOC_TYPE_NONE) {
+        return;
+    }
+    type_t* base = type_intern(gen->prs->types, &(type_t){ .kind = kind });
+    *opr = type_intern(gen->prs->types, &(type_t){ .kind = XOC_TYPE_TMP, .val = (*opr)->val, .base = base });
+}
+
+static void gen_typed_inst(gen_t* gen, inst_t* inst) {
+    tokenkind_t tk = inst->opr[0]->val.WPtr;
+    typekind_t res = XOC_TYPE_NONE;
+    if (inst->opc == XOC_OP_UNARY) {
+        typekind_t kind = gen_kind(gen, inst->opr[2]);
+        opcode_t opc = kind == XOC_TYPE_NONE ? XOC_OP_UNARY : gen_unary_op(tk, kind);
+        if (opc != XOC_OP_UNARY) {
+            inst->opc = opc;
+            gen->pid++;
+        }
+        if (tk == XOC_TOK_NOT) {
+            res = XOC_TYPE_I64;
+        } else if (tk != XOC_TOK_AND) {
+            res = kind;
+        }
+        gen_annotate(gen, &inst->opr[2]);
+    } else {
+        typekind_t kind = gen_promote(gen_kind(gen, inst->opr[2]), gen_kind(gen, inst->opr[3]));
+        opcode_t opc = kind == XOC_TYPE_NONE ? XOC_OP_BINARY : gen_binary_op(tk, kind);
+        if (opc != XOC_OP_BINARY && gen_coerce(gen, &inst->opr[2], kind) && gen_coerce(gen, &inst->opr[3], kind)) {
+            inst->opc = opc;
+            gen->pid++;
+        }
+        res = gen_is_cmp(tk) ? XOC_TYPE_I64 : kind;
+        gen_annotate(gen, &inst->opr[2]);
+        gen_annotate(gen, &inst->opr[3]);
+    }
+    type_t* dst = inst->opr[1];
+    if (dst && dst->kind == XOC_TYPE_TMP && dst->val.WPtr < (uint64_t)gen->size) {
+        gen->tmp_kind[dst->val.WPtr] = res;
+    }
+}
+
+void gen_typed(gen_t* gen) {
+    // Temps are defined before use in block order, one forward pass is enough
+    inst_t* blk;
+    for (int n = 0; (blk = (inst_t*)pool_nat(gen->prs->blks, n)); n++) {
+        for (int i = 0; i < pool_nsize(blk); i++) {
+            if (blk[i].opc == XOC_OP_UNARY || blk[i].opc == XOC_OP_BINARY) {
+                gen_typed_inst(gen, &blk[i]);
+            }
+        }
+    }
+}
+
+
+// Open-addressing map from a 64-bit key (ident/label key, constant bits) to
+// a slot or pc, private to lowering
+typedef struct gen_keytbl {
+    uint64_t* keys;
+    int* vals;
+    int cap;
+    int size;
+} gen_keytbl_t;
+
+static void gen_keytbl_init(gen_keytbl_t* tbl, int cap) {
+    tbl->cap = 16;
+    while (tbl->cap < cap * 2) {
+        tbl->cap *= 2;
+    }
+    tbl->size = 0;
+    tbl->keys = (uint64_t*)malloc(tbl->cap * sizeof(uint64_t));
+    tbl->vals = (int*)malloc(tbl->cap * sizeof(int));
+    memset(tbl->vals, -1, tbl->cap * sizeof(int));
+}
+
+static void gen_keytbl_free(gen_keytbl_t* tbl) {
+    free(tbl->keys);
+    free(tbl->vals);
+}
+
+static int* gen_keytbl_at(gen_keytbl_t* tbl, uint64_t key) {
+    uint64_t i = (key * 0x9E3779B97F4A7C15ull) >> 32;
+    for (;; i++) {
+        i &= tbl->cap - 1;
+        if (tbl->vals[i] < 0 || tbl->keys[i] == key) {
+            tbl->keys[i] = key;
+            return &tbl->vals[i];
+        }
+    }
+}
+
+static int gen_keytbl_get(gen_keytbl_t* tbl, uint64_t key) {
+    return *gen_keytbl_at(tbl, key);
+}
+
+static int gen_keytbl_add(gen_keytbl_t* tbl, uint64_t key, int val) {
+    if ((tbl->size + 1) * 2 > tbl->cap) {
+        gen_keytbl_t old = *tbl;
+        gen_keytbl_init(tbl, old.cap);
+        for (int i = 0; i < old.cap; i++) {
+            if (old.vals[i] >= 0) {
+                *gen_keytbl_at(tbl, old.keys[i]) = old.vals[i];
+                tbl->size++;
+            }
+        }
+        gen_keytbl_free(&old);
+    }
+    int* at = gen_keytbl_at(tbl, key);
+    if (*at < 0) {
+        *at = val;
+        tbl->size++;
+    }
+    return *at;
+}
+
+typedef struct gen_lower {
+    gen_keytbl_t idts;                                  /** Ident key -> local index */
+    gen_keytbl_t lbls;                                  /** Label key -> pc */
+    gen_keytbl_t kons;                                  /** Constant bits -> pool index */
+    prog_t* prog;
+    int num_konst_cap;
+    struct gen_switch* sws;                             /** Switch layouts, in block order */
+    int num_sw;
+} gen_lower_t;
+
+static bool gen_is_const(type_t* opr) {
+    return (opr->kind >= XOC_TYPE_I8 && opr->kind <= XOC_TYPE_F64) ||
+            opr->kind == XOC_TYPE_STR || opr->kind == XOC_TYPE_NULL;
+}
+
+// Constants are widened into their slot domain, the same way the engine keeps
+// computed values
+static arg_t gen_const_val(type_t* opr) {
+    arg_t val = { .U64 = 0 };
+    switch (opr->kind) {
+        case XOC_TYPE_I8:   val.I64 = opr->val.I8;   break;
+        case XOC_TYPE_I16:  val.I64 = opr->val.I16;  break;
+        case XOC_TYPE_I32:  val.I64 = opr->val.I32;  break;
+        case XOC_TYPE_U8:   val.U64 = opr->val.U8;   break;
+        case XOC_TYPE_U16:  val.U64 = opr->val.U16;  break;
+        case XOC_TYPE_U32:  val.U64 = opr->val.U32;  break;
+        case XOC_TYPE_F32:  val.F64 = opr->val.F32;  break;
+        default:            val = opr->val;          break;
+    }
+    return val;
+}
+
+// Kind of a numeric literal, NONE for anything else
+static typekind_t gen_num_kind(gen_t* gen, type_t* opr) {
+    return opr && opr->kind != XOC_TYPE_TMP ? gen_kind(gen, opr) : XOC_TYPE_NONE;
+}
+
+static type_t* gen_num(gen_t* gen, typekind_t kind, arg_t val) {
+    switch (kind) {
+        case XOC_TYPE_U64:  return type_u64(gen->prs->types, val.U64);
+        case XOC_TYPE_F64:  return type_f64(gen->prs->types, val.F64);
+        default:            return type_i64(gen->prs->types, val.I64);
+    }
+}
+
+// Dense ID of the ident a name operand resolved to: module names by symbol,
+// block locals by serial after every symbol
+static uint32_t gen_var(gen_t* gen, uint32_t key, uint64_t uid) {
+    return uid ? gen->prs->syms->size + (uint32_t)uid - 1 : key;
+}
+
+// A value operand once folding is done: a folded temp reads as what it
+// folded to, a propagated constant as its value
+static type_t* gen_val(gen_t* gen, type_t* opr) {
+    if (!opr) {
+        return opr;
+    }
+    if (opr->kind == XOC_TYPE_TMP && gen->tmp_val && opr->val.WPtr < (uint64_t)gen->size && gen->tmp_val[opr->val.WPtr]) {
+        return gen->tmp_val[opr->val.WPtr];
+    }
+    if (opr->kind == XOC_TYPE_ANY) {
+        uint32_t var = gen_var(gen, opr->key, opr->val.U64);
+        if (var < (uint32_t)gen->num_key && gen->key_val[var]) {
+            return gen->key_val[var];
+        }
+    }
+    return opr;
+}
+
+// Ops that carry their operator token in opr[0]: the generic ones and the
+// typed arithmetic gen_typed picked for them
+static bool gen_is_arith(opcode_t opc) {
+    return opc >= XOC_OP_UNARY && opc <= XOC_OP_GE_F64;
+}
+
+static bool gen_is_unary(opcode_t opc) {
+    return opc == XOC_OP_UNARY || (opc >= XOC_OP_NEG_I64 && opc <= XOC_OP_BNOT_I64);
+}
+
+// Insts whose result is known, so nothing is emitted for them
+static bool gen_is_folded(gen_t* gen, inst_t* inst) {
+    if (gen_is_arith(inst->opc)) {
+        type_t* dst = inst->opr[1];
+        return gen->tmp_val && dst && dst->kind == XOC_TYPE_TMP && dst->val.WPtr < (uint64_t)gen->size && gen->tmp_val[dst->val.WPtr];
+    }
+    if (inst->opc == XOC_OP_REG && inst->opr[2]) {
+        uint32_t var = gen_var(gen, inst->opr[2]->key, inst->opr[2]->val.U64);
+        return var < (uint32_t)gen->num_key && gen->key_val[var];
+    }
+    return false;
+}
+
+// `x op c` that gives back `x` or a constant for every x of an integer
+// domain. Float x is left alone: x + 0 turns -0 into +0 and x * 0 keeps NaN.
+static type_t* gen_identity(gen_t* gen, tokenkind_t tk, type_t* lhs, type_t* rhs) {
+    bool is_rhs = gen_num_kind(gen, rhs) != XOC_TYPE_NONE;
+    type_t *x = is_rhs ? lhs : rhs, *c = is_rhs ? rhs : lhs;
+    typekind_t ck = gen_num_kind(gen, c);
+    typekind_t xk = gen_kind(gen, x) == XOC_TYPE_NONE ? XOC_TYPE_I64 : gen_kind(gen, x);
+    if (ck == XOC_TYPE_NONE || ck == XOC_TYPE_F64 || xk == XOC_TYPE_F64 || gen_promote(xk, ck) != xk ||
+        (x->kind != XOC_TYPE_TMP && x->kind != XOC_TYPE_ANY)) {
+        return NULL;
+    }
+    int64_t v = gen_const_val(c).I64;
+    switch (tk) {
+        case XOC_TOK_PLUS:
+        case XOC_TOK_OR:
+        case XOC_TOK_XOR:   return v == 0 ? x : NULL;
+        case XOC_TOK_MINUS:
+        case XOC_TOK_SHL:
+        case XOC_TOK_SHR:   return is_rhs && v == 0 ? x : NULL;
+        case XOC_TOK_DIV:   return is_rhs && v == 1 ? x : NULL;
+        case XOC_TOK_MUL:   return v == 1 ? x : v == 0 ? gen_num(gen, xk, (arg_t){ .U64 = 0 }) : NULL;
+        case XOC_TOK_AND:   return v == -1 ? x : v == 0 ? gen_num(gen, xk, (arg_t){ .U64 = 0 }) : NULL;
+        default:            return NULL;
+    }
+}
+
+// Evaluate an op whose operands are known with the engine's own semantics.
+// Ops the engine would trap on, like integer division by zero, stay.
+static void gen_fold_inst(gen_t* gen, inst_t* inst) {
+    type_t* dst = inst->opr[1];
+    if (!dst || dst->kind != XOC_TYPE_TMP || dst->val.WPtr >= (uint64_t)gen->size) {
+        return;
+    }
+    tokenkind_t tk = inst->opr[0]->val.WPtr;
+    type_t* lhs = gen_val(gen, inst->opr[2]);
+    typekind_t lk = gen_num_kind(gen, lhs);
+    type_t* val = NULL;
+    arg_t l = lk != XOC_TYPE_NONE ? gen_const_val(lhs) : (arg_t){ .U64 = 0 }, res;
+    if (gen_is_unary(inst->opc)) {
+        if (lk != XOC_TYPE_NONE && tk != XOC_TOK_AND && engine_unary(&res, tk, lk, &l)) {
+            val = gen_num(gen, tk == XOC_TOK_NOT ? XOC_TYPE_I64 : lk, res);
+        } else if (tk == XOC_TOK_PLUS && lhs) {
+            val = lhs;
+        }
+    } else {
+        type_t* rhs = gen_val(gen, inst->opr[3]);
+        typekind_t rk = gen_num_kind(gen, rhs);
+        if (lk != XOC_TYPE_NONE && rk != XOC_TYPE_NONE) {
+            arg_t r = gen_const_val(rhs);
+            if (engine_binary(&res, tk, lk, &l, rk, &r)) {
+                val = gen_num(gen, gen_is_cmp(tk) ? XOC_TYPE_I64 : gen_promote(lk, rk), res);
+            }
+        } else if (lhs && rhs) {
+            val = gen_identity(gen, tk, lhs, rhs);
+        }
+    }
+    gen->tmp_val[dst->val.WPtr] = val;
+}
+
+static type_t gen_unknown;
+
+// Fold ops over known operands and propagate constants. A constant is
+// propagated when every write to its slot stores one and the same value:
+// slots are per ident, so an ident any var or assignment also uses is left
+// alone. Blocks are only read; the results live in the generator, so code
+// parsed once still folds against constants from units reparsed since.
+void gen_fold(gen_t* gen) {
+    parser_t* prs = gen->prs;
+    inst_t* blk;
+    gen->num_key = prs->syms->size + prs->num_local;
+    gen->tmp_val = (type_t**)calloc(gen->size > 0 ? gen->size : 1, sizeof(type_t*));
+    gen->key_val = (type_t**)calloc(gen->num_key, sizeof(type_t*));
+    gen->num_fold = 0;
+    // 1. Idents declared only as constants and never assigned
+    uint8_t* is_const = (uint8_t*)calloc(gen->num_key, sizeof(uint8_t));
+    for (int i = 0; i < pool_nsize(prs->idt_cur); i++) {
+        ident_t* idt = &prs->idt_cur[i];
+        uint32_t var = gen_var(gen, idt->key, idt->uid);
+        if (var < (uint32_t)gen->num_key) {
+            is_const[var] |= idt->kind == XOC_IDT_CONST ? 1 : 2;
+        }
+    }
+    // A temp written on both sides of a short-circuit holds no one value
+    uint8_t* num_def = (uint8_t*)calloc(gen->size > 0 ? gen->size : 1, sizeof(uint8_t));
+    for (int n = 0; (blk = (inst_t*)pool_nat(prs->blks, n)); n++) {
+        for (int i = 0; i < pool_nsize(blk); i++) {
+            type_t* dst = blk[i].opr[0];
+            uint32_t var = dst && dst->kind == XOC_TYPE_ANY ? gen_var(gen, dst->key, dst->val.U64) : (uint32_t)gen->num_key;
+            if (blk[i].opc == XOC_OP_ASSIGN && var < (uint32_t)gen->num_key) {
+                is_const[var] = 2;
+            }
+            dst = blk[i].opr[1];
+            if (gen_is_arith(blk[i].opc) && dst && dst->kind == XOC_TYPE_TMP && dst->val.WPtr < (uint64_t)gen->size && num_def[dst->val.WPtr] < 2) {
+                num_def[dst->val.WPtr]++;
+            }
+        }
+    }
+
+    // 2. Fold forward in block order, temps are defined before use. A pass
+    //    that settles new constants folds again with them.
+    type_t** cand = (type_t**)calloc(gen->num_key, sizeof(type_t*));
+    bool is_grown = true;
+    while (is_grown) {
+        memset(gen->tmp_val, 0, (gen->size > 0 ? gen->size : 1) * sizeof(type_t*));
+        memset(cand, 0, gen->num_key * sizeof(type_t*));
+        for (int n = 0; (blk = (inst_t*)pool_nat(prs->blks, n)); n++) {
+            for (int i = 0; i < pool_nsize(blk); i++) {
+                inst_t* inst = &blk[i];
+                type_t* idt = inst->opc == XOC_OP_REG ? inst->opr[2] : NULL;
+                uint32_t key = idt ? gen_var(gen, idt->key, idt->val.U64) : (uint32_t)gen->num_key;
+                if (gen_is_arith(inst->opc)) {
+                    type_t* dst = inst->opr[1];
+                    if (dst && dst->kind == XOC_TYPE_TMP && dst->val.WPtr < (uint64_t)gen->size && num_def[dst->val.WPtr] == 1) {
+                        gen_fold_inst(gen, inst);
+                    }
+                } else if (key < (uint32_t)gen->num_key && is_const[key] == 1 && !gen->key_val[key]) {
+                    // A write not known yet may be in a later pass; two
+                    // different values never agree
+                    type_t* val = gen_val(gen, inst->opr[0]);
+                    if (gen_num_kind(gen, val) == XOC_TYPE_NONE) {
+                        cand[key] = &gen_unknown;
+                    } else if (!cand[key]) {
+                        cand[key] = val;
+                    } else if (cand[key] != val && cand[key] != &gen_unknown) {
+                        is_const[key] = 2;
+                    }
+                }
+            }
+        }
+        is_grown = false;
+        for (int k = 0; k < gen->num_key; k++) {
+            if (is_const[k] == 1 && cand[k] && cand[k] != &gen_unknown && !gen->key_val[k]) {
+                gen->key_val[k] = cand[k];
+                is_grown = true;
+            }
+        }
+    }
+    for (int n = 0; (blk = (inst_t*)pool_nat(prs->blks, n)); n++) {
+        for (int i = 0; i < pool_nsize(blk); i++) {
+            gen->num_fold += gen_is_folded(gen, &blk[i]);
+        }
+    }
+    free(cand);
+    free(num_def);
+    free(is_const);
+}
+
+static uint8_t gen_dom(gen_t* gen, type_t* opr) {
+    opr = gen_val(gen, opr);
+    typekind_t kind = opr->kind;
+    if (kind == XOC_TYPE_TMP) {
+        kind = gen_kind(gen, opr);
+    }
+    switch (kind) {
+        case XOC_TYPE_F32:
+        case XOC_TYPE_F64:  return XOC_DOM_F64;
+        case XOC_TYPE_U8:
+        case XOC_TYPE_U16:
+        case XOC_TYPE_U32:
+        case XOC_TYPE_U64:  return XOC_DOM_U64;
+        case XOC_TYPE_STR:  return XOC_DOM_STR;
+        default:            return XOC_DOM_I64;
+    }
+}
+
+static void gen_collect(gen_t* gen, gen_lower_t* low, type_t* opr) {
+    opr = gen_val(gen, opr);
+    if (!opr) {
+        return;
+    }
+    if (opr->kind == XOC_TYPE_ANY) {
+        gen_keytbl_add(&low->idts, gen_var(gen, opr->key, opr->val.U64), low->idts.size);
+    } else if (gen_is_const(opr)) {
+        arg_t val = gen_const_val(opr);
+        if (gen_keytbl_add(&low->kons, val.U64, low->kons.size) == low->prog->num_konst) {
+            if (low->prog->num_konst == low->num_konst_cap) {
+                low->num_konst_cap = low->num_konst_cap ? low->num_konst_cap * 2 : 16;
+                low->prog->konst = (arg_t*)realloc(low->prog->konst, low->num_konst_cap * sizeof(arg_t));
+            }
+            low->prog->konst[low->prog->num_konst++] = val;
+        }
+    }
+}
+
+static uint16_t gen_slot(gen_t* gen, gen_lower_t* low, type_t* opr) {
+    opr = gen_val(gen, opr);
+    if (!opr) {
+        return 0;
+    }
+    switch (opr->kind) {
+        case XOC_TYPE_TMP:  return opr->val.WPtr;
+        case XOC_TYPE_ANY:  return gen->size + gen_keytbl_get(&low->idts, gen_var(gen, opr->key, opr->val.U64));
+        default:
+            if (gen_is_const(opr)) {
+                return low->prog->num_slot + gen_keytbl_get(&low->kons, gen_const_val(opr).U64);
+            }
+            gen->log->fmt(gen->prs->info, "Unable to lower operand of kind %d", opr->kind);
+            return 0;
+    }
+}
+
+static int64_t gen_target(gen_t* gen, gen_lower_t* low, type_t* opr) {
+    int pc = opr && opr->kind == XOC_TYPE_LBL ? gen_keytbl_get(&low->lbls, opr->val.WPtr) : -1;
+    if (pc < 0) {
+        gen->log->fmt(gen->prs->info, "Unable to resolve jump target");
+        return low->prog->num_code - 1;
+    }
+    return pc;
+}
+
+// Block labels live in blk[0].label and survive pushes into the block, so a
+// leading inst may carry the label of its block rather than its own
+static bool gen_is_blk_label(gen_lower_t* low, inst_t* inst) {
+    return inst->label && gen_keytbl_get(&low->lbls, inst->label) != -1;
+}
+
+static code_t gen_lower_inst(gen_t* gen, gen_lower_t* low, inst_t* inst) {
+    code_t code = { .opc = inst->opc };
+    switch (inst->opc) {
+        case XOC_OP_REG:
+            code.opc = inst->opr[2] ? XOC_OP_ASSIGN : XOC_OP_NOP;
+            if (code.opc == XOC_OP_ASSIGN) {
+                code.a = gen_slot(gen, low, inst->opr[2]);
+                code.b = gen_slot(gen, low, inst->opr[0]);
+            }
+            break;
+        case XOC_OP_UNARY:
+            code.imm.I64 = inst->opr[0]->val.WPtr;
+            code.mode = code_mode(gen_dom(gen, inst->opr[2]), 0);
+            // fallthrough
+        case XOC_OP_NEG_I64:
+        case XOC_OP_NEG_F64:
+        case XOC_OP_NOT_I64:
+        case XOC_OP_BNOT_I64:
+            code.a = gen_slot(gen, low, inst->opr[1]);
+            code.b = gen_slot(gen, low, inst->opr[2]);
+            break;
+        case XOC_OP_ASSIGN:
+            code.a = gen_slot(gen, low, inst->opr[0]);
+            code.b = gen_slot(gen, low, inst->opr[1]);
+            break;
+        case XOC_OP_JMP:
+            code.imm.I64 = gen_target(gen, low, inst->opr[0]);
+            break;
+        case XOC_OP_JMP_IF:
+        case XOC_OP_JMP_IFN:
+            code.imm.I64 = gen_target(gen, low, inst->opr[0]);
+            code.b = gen_slot(gen, low, inst->opr[1]);
+            break;
+        case XOC_OP_JMP_IFEQ:
+        case XOC_OP_JMP_IFNE:
+            code.imm.I64 = gen_target(gen, low, inst->opr[0]);
+            code.b = gen_slot(gen, low, inst->opr[1]);
+            code.c = gen_slot(gen, low, inst->opr[2]);
+            code.mode = code_mode(gen_dom(gen, inst->opr[1]), gen_dom(gen, inst->opr[2]));
+            break;
+        case XOC_OP_RET:
+            // Units are lowered as a single top-level frame
+            code.opc = XOC_OP_HALT;
+            break;
+        default:
+            if (inst->opc >= XOC_OP_BINARY && inst->opc <= XOC_OP_GE_F64) {
+                code.a = gen_slot(gen, low, inst->opr[1]);
+                code.b = gen_slot(gen, low, inst->opr[2]);
+                code.c = gen_slot(gen, low, inst->opr[3]);
+                if (inst->opc == XOC_OP_BINARY) {
+                    code.imm.I64 = inst->opr[0]->val.WPtr;
+                    code.mode = code_mode(gen_dom(gen, inst->opr[2]), gen_dom(gen, inst->opr[3]));
+                }
+            } else {
+                gen->log->fmt(gen->prs->info, "Unable to lower op %d", inst->opc);
+                code.opc = XOC_OP_NOP;
+            }
+            break;
+    }
+    return code;
+}
+
+static const char* gen_switch_mnemonic_tbl[GEN_NUM_SWITCH] = {
+    [GEN_SWITCH_CHAIN]  = "chain",
+    [GEN_SWITCH_TABLE]  = "table",
+    [GEN_SWITCH_TREE]   = "tree",
+    [GEN_SWITCH_HASH]   = "hash",
+};
+
+typedef struct gen_case {
+    type_t* val;                                        /** Value operand, once folded */
+    type_t* lbl;                                        /** Label of the body it enters */
+    int64_t key;                                        /** Value ordered the way the selector compares */
+    int ord;                                            /** Position in source */
+} gen_case_t;
+
+// A switch as it is laid out, planned before its pc is known and emitted
+// once every label has one
+typedef struct gen_switch {
+    gen_switchkind_t kind;
+    gen_case_t* cases;                                  /** Source order for a chain, else sorted and unique */
+    int num;
+    uint8_t dom;                                        /** Domain the selector is compared in */
+    uint64_t imm;                                       /** Table: first value, hash: multiplier */
+    int span;                                           /** Table: number of entries, hash: bits */
+    int size;                                           /** Number of codes */
+} gen_switch_t;
+
+static int gen_case_cmp(const void* a, const void* b) {
+    const gen_case_t *x = (const gen_case_t*)a, *y = (const gen_case_t*)b;
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return x->ord - y->ord;
+}
+
+// Codes of a compare tree over `num` sorted values: up to three are tested
+// in turn, more split at the middle one
+static int gen_switch_tree_size(int num) {
+    if (num <= 3) {
+        return num + 1;
+    }
+    return 2 + gen_switch_tree_size(num - num / 2 - 1) + gen_switch_tree_size(num / 2);
+}
+
+// Hash of a string case as JMP_HASH takes it at run time
+static uint64_t gen_switch_strhash(type_t* val) {
+    const char* str = (const char*)val->val.WPtr;
+    return xoc_hashn(str, strlen(str));
+}
+
+// Multiplier that sends every string to its own bucket of 2^bits, 0 if none
+// of the ones tried does
+static uint64_t gen_switch_hash(gen_case_t* cases, int num, int bits) {
+    uint8_t* used = (uint8_t*)malloc((size_t)1 << bits);
+    uint64_t mul = 0;
+    for (int k = 0; k < 32 && !mul; k++) {
+        uint64_t cand = 0x9E3779B97F4A7C15ull + 2 * k * 0xBF58476D1CE4E5B9ull;
+        memset(used, 0, (size_t)1 << bits);
+        int i = 0;
+        for (; i < num; i++) {
+            uint64_t h = (gen_switch_strhash(cases[i].val) * cand) >> (64 - bits);
+            if (used[h]) {
+                break;
+            }
+            used[h] = 1;
+        }
+        mul = i == num ? cand : 0;
+    }
+    free(used);
+    return mul;
+}
+
+// Pick how to dispatch: constant integer values become a table when they
+// fill enough of their range and a compare tree otherwise. Constant strings
+// become a hash of their contents; the selector is read as a string and
+// compared by contents in every layout. Few or mixed values, floats or
+// values computed at run time stay a chain.
+static gen_switch_t gen_switch_plan(gen_t* gen, inst_t* inst) {
+    gen_switch_t sw = { .kind = GEN_SWITCH_CHAIN, .dom = gen_dom(gen, inst->opr[1]) };
+    for (type_t* cas = inst->opr[2]; cas; cas = cas->next) {
+        sw.num++;
+    }
+    sw.cases = (gen_case_t*)malloc((sw.num > 0 ? sw.num : 1) * sizeof(gen_case_t));
+    type_t* sel = gen_val(gen, inst->opr[1]);
+    bool is_int = sw.dom != XOC_DOM_F64;
+    bool is_str = sw.num > 0 && gen_kind(gen, sel) == XOC_TYPE_NONE;
+    int num = 0;
+    for (type_t* cas = inst->opr[2]; cas; cas = cas->next, num++) {
+        type_t* val = gen_val(gen, cas->base);
+        typekind_t kind = gen_num_kind(gen, val);
+        is_int = is_int && (kind == XOC_TYPE_I64 || kind == XOC_TYPE_U64);
+        is_str = is_str && val->kind == XOC_TYPE_STR;
+        // Flipping the sign bit orders unsigned values as signed ones
+        int64_t key = (int64_t)(gen_const_val(val).U64 ^ (sw.dom == XOC_DOM_U64 ? 1ull << 63 : 0));
+        sw.cases[num] = (gen_case_t){ .val = val, .lbl = cas, .key = key, .ord = num };
+    }
+    if (is_str) {
+        sw.dom = XOC_DOM_STR;
+    }
+    sw.size = sw.num + 1;
+    if (sw.num < GEN_SWITCH_MIN_VALUES || !(is_int || is_str)) {
+        return sw;
+    }
+
+    // The first of equal values in source order is the one that matches
+    qsort(sw.cases, sw.num, sizeof(gen_case_t), gen_case_cmp);
+    num = 1;
+    for (int i = 1; i < sw.num; i++) {
+        if (sw.cases[i].key != sw.cases[num - 1].key) {
+            sw.cases[num++] = sw.cases[i];
+        }
+    }
+    sw.num = num;
+    uint64_t lo = gen_const_val(sw.cases[0].val).U64;
+    uint64_t range = gen_const_val(sw.cases[num - 1].val).U64 - lo;
+    if (is_int && range < GEN_SWITCH_MAX_SPAN && (uint64_t)num * 100 >= (range + 1) * GEN_SWITCH_MIN_FILL) {
+        sw.kind = GEN_SWITCH_TABLE;
+        sw.imm = lo;
+        sw.span = range + 1;
+        sw.size = 1 + sw.span + 1;
+        return sw;
+    }
+    if (is_str) {
+        int bits = 1;
+        while ((1 << bits) < num) {
+            bits++;
+        }
+        for (int top = bits + 2; bits <= top && bits <= GEN_SWITCH_MAX_HASH; bits++) {
+            if ((sw.imm = gen_switch_hash(sw.cases, num, bits))) {
+                sw.kind = GEN_SWITCH_HASH;
+                sw.span = bits;
+                sw.size = 1 + 2 * (1 << bits);
+                return sw;
+            }
+        }
+        // Strings are sorted by pointer, not by contents: no tree
+        return sw;
+    }
+    sw.kind = GEN_SWITCH_TREE;
+    sw.size = gen_switch_tree_size(num);
+    return sw;
+}
+
+static code_t gen_switch_cmp(gen_t* gen, gen_lower_t* low, opcode_t opc, int64_t to, uint16_t sel, gen_switch_t* sw, gen_case_t* cas) {
+    code_t code = { .opc = opc, .b = sel, .c = gen_slot(gen, low, cas->val), .imm = { .I64 = to } };
+    // A chain compares like ==, the rest in the selector's domain as sorted
+    code.mode = sw->kind == GEN_SWITCH_CHAIN ? code_mode(sw->dom, gen_dom(gen, cas->val)) : code_mode(sw->dom, sw->dom);
+    return code;
+}
+
+static int gen_switch_tree(gen_t* gen, gen_lower_t* low, gen_switch_t* sw, gen_case_t* cases, int num, uint16_t sel, int64_t dft, int pc) {
+    code_t* code = low->prog->code;
+    if (num <= 3) {
+        for (int i = 0; i < num; i++) {
+            code[pc++] = gen_switch_cmp(gen, low, XOC_OP_JMP_IFEQ, gen_target(gen, low, cases[i].lbl), sel, sw, &cases[i]);
+        }
+        code[pc++] = (code_t){ .opc = XOC_OP_JMP, .imm = { .I64 = dft } };
+        return pc;
+    }
+    int mid = num / 2, right = pc + 2, left = right + gen_switch_tree_size(num - mid - 1);
+    code[pc] = gen_switch_cmp(gen, low, XOC_OP_JMP_IFLT, left, sel, sw, &cases[mid]);
+    code[pc + 1] = gen_switch_cmp(gen, low, XOC_OP_JMP_IFEQ, gen_target(gen, low, cases[mid].lbl), sel, sw, &cases[mid]);
+    gen_switch_tree(gen, low, sw, cases + mid + 1, num - mid - 1, sel, dft, right);
+    return gen_switch_tree(gen, low, sw, cases, mid, sel, dft, left);
+}
+
+static void gen_switch_emit(gen_t* gen, gen_lower_t* low, gen_switch_t* sw, inst_t* inst, int pc) {
+    code_t* code = low->prog->code;
+    uint16_t sel = gen_slot(gen, low, inst->opr[1]);
+    int64_t dft = gen_target(gen, low, inst->opr[0]);
+    switch (sw->kind) {
+        case GEN_SWITCH_CHAIN:
+            for (int i = 0; i < sw->num; i++) {
+                code[pc++] = gen_switch_cmp(gen, low, XOC_OP_JMP_IFEQ, gen_target(gen, low, sw->cases[i].lbl), sel, sw, &sw->cases[i]);
+            }
+            code[pc] = (code_t){ .opc = XOC_OP_JMP, .imm = { .I64 = dft } };
+            break;
+        case GEN_SWITCH_TABLE:
+            code[pc] = (code_t){ .opc = XOC_OP_JMP_TBL, .b = sel, .c = sw->span, .imm = { .U64 = sw->imm } };
+            for (int i = 0; i <= sw->span; i++) {
+                code[pc + 1 + i] = (code_t){ .opc = XOC_OP_JMP, .imm = { .I64 = dft } };
+            }
+            for (int i = 0; i < sw->num; i++) {
+                code[pc + 1 + (gen_const_val(sw->cases[i].val).U64 - sw->imm)].imm.I64 = gen_target(gen, low, sw->cases[i].lbl);
+            }
+            break;
+        case GEN_SWITCH_TREE:
+            gen_switch_tree(gen, low, sw, sw->cases, sw->num, sel, dft, pc);
+            break;
+        case GEN_SWITCH_HASH:
+            code[pc] = (code_t){ .opc = XOC_OP_JMP_HASH, .mode = code_mode(XOC_DOM_STR, 0), .b = sel, .c = sw->span, .imm = { .U64 = sw->imm } };
+            for (int i = 0; i < 2 << sw->span; i++) {
+                code[pc + 1 + i] = (code_t){ .opc = XOC_OP_JMP, .imm = { .I64 = dft } };
+            }
+            for (int i = 0; i < sw->num; i++) {
+                uint64_t h = (gen_switch_strhash(sw->cases[i].val) * sw->imm) >> (64 - sw->span);
+                code[pc + 1 + 2 * h] = gen_switch_cmp(gen, low, XOC_OP_JMP_IFEQ, gen_target(gen, low, sw->cases[i].lbl), sel, sw, &sw->cases[i]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Lay the blocks out as one frame of slot-addressed code. Returns -1 and
+// leaves `prog` empty when the frame needs more slots than codes address.
+int gen_lower(gen_t* gen, prog_t* prog) {
+    gen_lower_t low = { .prog = prog, .num_konst_cap = 0 };
+    inst_t* blk;
+    memset(prog, 0, sizeof(prog_t));
+    gen_keytbl_init(&low.idts, 64);
+    gen_keytbl_init(&low.lbls, 64);
+    gen_keytbl_init(&low.kons, 64);
+
+    // 1. Jump targets, so block labels can be told apart from inst labels
+    for (int n = 0; (blk = (inst_t*)pool_nat(gen->prs->blks, n)); n++) {
+        for (int i = 0; i < pool_nsize(blk); i++) {
+            if (blk[i].opr[0] && blk[i].opr[0]->kind == XOC_TYPE_LBL) {
+                gen_keytbl_add(&low.lbls, blk[i].opr[0]->val.WPtr, 0);
+            }
+            for (type_t* cas = blk[i].opc == XOC_OP_SWITCH ? blk[i].opr[2] : NULL; cas; cas = cas->next) {
+                gen_keytbl_add(&low.lbls, cas->val.WPtr, 0);
+            }
+        }
+    }
+
+    // 2. Layout: block pcs, local slots and the constant pool
+    int pc = 1;
+    for (int n = 0; (blk = (inst_t*)pool_nat(gen->prs->blks, n)); n++) {
+        if (gen_is_blk_label(&low, &blk[0])) {
+            *gen_keytbl_at(&low.lbls, blk[0].label) = pc;
+        }
+        for (int i = 0; i < pool_nsize(blk); i++) {
+            if (gen_is_folded(gen, &blk[i])) {
+                continue;
+            }
+            if (blk[i].opc == XOC_OP_SWITCH) {
+                gen_switch_t sw = gen_switch_plan(gen, &blk[i]);
+                gen->num_switch[sw.kind]++;
+                log_at(gen->log, XOC_LOG_GEN, XOC_LOG_DEBUG, gen->prs->info, "Switch on %d values as %s, %d codes",
+                       sw.num, gen_switch_mnemonic_tbl[sw.kind], sw.size);
+                gen_collect(gen, &low, blk[i].opr[1]);
+                for (int j = 0; j < sw.num && sw.kind != GEN_SWITCH_TABLE; j++) {
+                    gen_collect(gen, &low, sw.cases[j].val);
+                }
+                low.sws = (gen_switch_t*)realloc(low.sws, (low.num_sw + 1) * sizeof(gen_switch_t));
+                low.sws[low.num_sw++] = sw;
+                pc += sw.size;
+                continue;
+            }
+            pc++;
+            if (blk[i].opc == XOC_OP_REG) {
+                gen_collect(gen, &low, blk[i].opr[2]);
+            }
+            for (int j = 0; j < 4; j++) {
+                gen_collect(gen, &low, blk[i].opr[j]);
+            }
+        }
+    }
+    prog->num_code = pc + 1;
+    prog->num_slot = gen->size + low.idts.size;
+    if (prog->num_slot + prog->num_konst > XOC_MAX_SLOT) {
+        // Slots are 16-bit code operands: nothing is emitted past the limit
+        gen->log->fmt(gen->prs->info, "Too many slots: %d", prog->num_slot + prog->num_konst);
+        for (int i = 0; i < low.num_sw; i++) {
+            free(low.sws[i].cases);
+        }
+        free(low.sws);
+        prog_free(prog);
+        memset(prog, 0, sizeof(prog_t));
+        gen_keytbl_free(&low.idts);
+        gen_keytbl_free(&low.lbls);
+        gen_keytbl_free(&low.kons);
+        return -1;
+    }
+
+    // 3. Emit: frame prologue, body, halt
+    prog->code = (code_t*)calloc(prog->num_code, sizeof(code_t));
+    prog->code[0] = (code_t){
+        .opc = XOC_OP_ENTER_FRAME,
+        .b   = prog->num_slot,
+        .c   = prog->num_konst,
+        .imm = { .I64 = prog->num_slot + prog->num_konst }
+    };
+    pc = 1;
+    int num_sw = 0;
+    for (int n = 0; (blk = (inst_t*)pool_nat(gen->prs->blks, n)); n++) {
+        for (int i = 0; i < pool_nsize(blk); i++) {
+            if (gen_is_folded(gen, &blk[i])) {
+                continue;
+            }
+            if (blk[i].opc == XOC_OP_SWITCH) {
+                gen_switch_t* sw = &low.sws[num_sw++];
+                gen_switch_emit(gen, &low, sw, &blk[i], pc);
+                pc += sw->size;
+                free(sw->cases);
+                continue;
+            }
+            prog->code[pc++] = gen_lower_inst(gen, &low, &blk[i]);
+        }
+    }
+    free(low.sws);
+    prog->code[pc] = (code_t){ .opc = XOC_OP_HALT };
+
+    // 4. Slots of module names, for whoever reads the frame after a run
+    gen->num_sym = gen->prs->syms->size;
+    gen->sym_slot = (int*)realloc(gen->sym_slot, (gen->num_sym > 0 ? gen->num_sym : 1) * sizeof(int));
+    for (int k = 0; k < gen->num_sym; k++) {
+        int at = gen_keytbl_get(&low.idts, k);
+        gen->sym_slot[k] = at < 0 ? -1 : gen->size + at;
+    }
+
+    gen_keytbl_free(&low.idts);
+    gen_keytbl_free(&low.lbls);
+    gen_keytbl_free(&low.kons);
+    return 0;
+}
+
+// Slot of a module-level name in the frame gen_lower laid out, -1 when the
+// name has none, like a constant that was propagated away
+int gen_slotof(gen_t* gen, uint32_t sym) {
+    return sym < (uint32_t)gen->num_sym ? gen->sym_slot[sym] : -1;
+}
@@ -5,7 +5,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int  parser_term_level(parser_t* prs, tokenkind_t tk);
 static void parser_param_list(parser_t* prs);
 static void parser_selectors(parser_t* prs);
 static void parser_qualident(parser_t* prs);
@@ -42,7 +41,8 @@ static void parser_decl_fn(parser_t* prs);
 static void parser_decl(parser_t* prs);
 static void parser_decls(parser_t* prs);
 static void parser_factor(parser_t* prs);
-static void parser_term_n(parser_t* prs, int n);
+static void parser_binary(parser_t* prs, int min);
+static void parser_cond(parser_t* prs, uint32_t lbl_false);
 static void parser_expr(parser_t* prs);
 static void parser_exprlist(parser_t* prs);
 static void parser_stmt_assign(parser_t* prs);
@@ -57,19 +57,19 @@ static void parser_stmtlist(parser_t* prs);
 static void parser_block(parser_t* prs);
 
 
-void blk_info(inst_t* blk, char* buf, int size, map_t* syms) {
+void blk_info(inst_t* blk, char* buf, int size, intern_t* syms, log_t* log) {
     int i;
     if(pool_nsize(blk) == 0) {
         if(blk[0].label) {
-            printf("\n│ %%%-46s │", map_get(syms, blk[0].label));
+            log->fmt(NULL, "\n│ %%%-46s │", intern_get(syms, blk[0].label));
         }
     }
     for (i = 0; i < pool_nsize(blk); i++) {
         inst_info(&blk[i], buf, 300, syms);
         if(blk[i].label) {
-            printf("\n│%-105s│", buf);
+            log->fmt(NULL, "\n│%-105s│", buf);
         } else {
-            printf("\n│%-49s│", buf);
+            log->fmt(NULL, "\n│%-49s│", buf);
         }
     }
 }
@@ -93,35 +93,8 @@ ident_t* parser_idt_alc(parser_t* prs, int cap) {
     return prs->idt_cur;
 }
 
-static int parser_term_level(parser_t* prs, tokenkind_t tk) {
-    switch (tk) {
-        case XOC_TOK_MUL: return 0;
-        case XOC_TOK_DIV: return 0;
-        case XOC_TOK_MOD: return 0;
-        case XOC_TOK_SHL: return 0;
-        case XOC_TOK_SHR: return 0;
-        case XOC_TOK_AND: return 0;
-
-        case XOC_TOK_PLUS: return 1;
-        case XOC_TOK_MINUS: return 1;
-        case XOC_TOK_OR: return 1;
-        case XOC_TOK_XOR: return 1;
-
-        case XOC_TOK_EQEQ: return 2;
-        case XOC_TOK_NOTEQ: return 2;
-        case XOC_TOK_LESS: return 2;
-        case XOC_TOK_LESSEQ: return 2;
-        case XOC_TOK_GREATER: return 2;
-        case XOC_TOK_GREATEREQ: return 2;
-
-        case XOC_TOK_ANDAND: return 3;
-        case XOC_TOK_OROR: return 4;
-        default: return -1;
-    }
-}
-
 void parser_push_insts(parser_t* prs, inst_t* insts, int size) {
-    uint64_t org_lbl = prs->blk_cur[0].label;
+    uint32_t org_lbl = prs->blk_cur[0].label;
     char* res = pool_npush(prs->blks, (char**)&prs->blk_cur, (char*)insts, size);
     if(!res) {
         prs->log->fmt(prs->info, "Unable to push insts: %p(%u+%d/%u)", insts, pool_nsize(prs->blk_cur), size, pool_ncap(prs->blk_cur));
@@ -132,20 +105,110 @@ void parser_push_insts(parser_t* prs, inst_t* insts, int size) {
     prs->iid++;
 }
 
+// Slot of a symbol in the scope table, grown to cover it
+static int* parser_scope_slot(parser_t* prs, uint32_t key) {
+    if ((int)key >= prs->cap_top) {
+        int cap = prs->cap_top ? prs->cap_top : 64;
+        while (cap <= (int)key) {
+            cap *= 2;
+        }
+        prs->idt_top = (int*)realloc(prs->idt_top, cap * sizeof(int));
+        memset(prs->idt_top + prs->cap_top, 0xff, (cap - prs->cap_top) * sizeof(int));
+        prs->cap_top = cap;
+    }
+    return &prs->idt_top[key];
+}
+
+// Make an ident what its name means from here on, hiding the one before.
+// Labels are addressed by key and never looked up by name.
+static void parser_scope_bind(parser_t* prs, int at) {
+    ident_t* idt = &prs->idt_cur[at];
+    idt->shadow = -1;
+    if (idt->kind == XOC_IDT_LABEL) {
+        return;
+    }
+    idt->is_global = prs->num_scope == 0;
+    if (!idt->is_global && !idt->uid) {
+        idt->uid = ++prs->num_local;
+    }
+    if (idt->is_global && prs->is_edit) {
+        return;
+    }
+    int* slot = parser_scope_slot(prs, idt->key);
+    idt->shadow = *slot;
+    *slot = at;
+}
+
+static void parser_scope_open(parser_t* prs) {
+    if (prs->num_scope == XOC_MAX_BLK_NEST) {
+        prs->log->fmt(prs->info, "Blocks nest deeper than %d", XOC_MAX_BLK_NEST);
+    }
+    // Past the limit names stay bound until the outermost untracked scope closes
+    if (prs->num_scope < XOC_MAX_BLK_NEST) {
+        prs->scopes[prs->num_scope] = pool_nsize(prs->idt_cur);
+    }
+    prs->num_scope++;
+}
+
+// Unbind every name declared from `from` on, newest first, so each shadowed
+// ident is visible again. The idents themselves stay in the table.
+static void parser_scope_unbind(parser_t* prs, int from) {
+    for (int i = pool_nsize(prs->idt_cur) - 1; i >= from; i--) {
+        ident_t* idt = &prs->idt_cur[i];
+        if (idt->kind != XOC_IDT_LABEL) {
+            prs->idt_top[idt->key] = idt->shadow;
+        }
+    }
+}
+
+static void parser_scope_close(parser_t* prs) {
+    prs->num_scope--;
+    if (prs->num_scope >= XOC_MAX_BLK_NEST) {
+        return;
+    }
+    parser_scope_unbind(prs, prs->scopes[prs->num_scope]);
+}
+
+// Bind the module names again from scratch, in declaration order
+static void parser_scope_rebind(parser_t* prs) {
+    if (prs->cap_top) {
+        memset(prs->idt_top, 0xff, prs->cap_top * sizeof(int));
+    }
+    for (int i = 0; i < pool_nsize(prs->idt_cur); i++) {
+        ident_t* idt = &prs->idt_cur[i];
+        if (idt->is_global && idt->kind != XOC_IDT_LABEL) {
+            int* slot = parser_scope_slot(prs, idt->key);
+            idt->shadow = *slot;
+            *slot = i;
+        }
+    }
+}
+
 void parser_push_idents(parser_t* prs, ident_t* idts, int size) {
+    int at = pool_nsize(prs->idt_cur);
     char* res = pool_npush(prs->idts, (char**)&prs->idt_cur, (char*)idts, size);
     if(!res) {
         prs->log->fmt(prs->info, "Unable to push idents: %p(%u+%d/%u)", idts, pool_nsize(prs->idt_cur), size, pool_ncap(prs->idt_cur));
+        return;
+    }
+    for (int i = at; i < at + size; i++) {
+        parser_scope_bind(prs, i);
     }
 }
 
-ident_t* parser_get_ident(parser_t* prs, uint64_t key) {
-    for (int i = 0; i < pool_nsize(prs->idts); i++) {
-        if (prs->idt_cur[i].key == key) {
-            return &prs->idt_cur[i];
-        }
+// Innermost ident in scope with the symbol, O(1)
+ident_t* parser_get_ident(parser_t* prs, uint32_t key) {
+    if ((int)key >= prs->cap_top || prs->idt_top[key] < 0) {
+        return NULL;
     }
-    return NULL;
+    return &prs->idt_cur[prs->idt_top[key]];
+}
+
+// Operand of a name as it resolves here; a name nothing declares yet is a
+// module name
+static type_t* parser_name(parser_t* prs, uint32_t key) {
+    ident_t* idt = parser_get_ident(prs, key);
+    return idt ? type_idt(prs->types, idt) : type_any(prs->types, key);
 }
 
 
@@ -161,7 +224,7 @@ inst_t* parser_blk_swc(parser_t* prs, int bid) {
     }
 }
 
-uint64_t parser_add_label(parser_t* prs, char* name) {
+uint32_t parser_add_label(parser_t* prs, char* name) {
     identname_t label;
     if (name == NULL) {
         sprintf(label, "_L%d", prs->lid);
@@ -170,20 +233,25 @@ uint64_t parser_add_label(parser_t* prs, char* name) {
     }
     int len = strlen(label);
     prs->lid++;
-    uint64_t key = map_add(prs->syms, label, len + 1);
+    uint32_t key = intern_add(prs->syms, label, len);
     parser_push_idents(prs, &(ident_t){
         .kind = XOC_IDT_LABEL,
-        .name = map_get(prs->syms, key),
+        .name = intern_get(prs->syms, key),
         .key = key
     }, 1);
     return key;
 }
 
-uint64_t parser_add_ident(parser_t* prs, char* name, identkind_t kind) {
-    uint64_t key = xoc_hash(name);
-    pool_npush(prs->idts, (char**)&prs->idt_cur, (char*)&(ident_t){
+// Identical literals share one NUL-terminated copy, and so one type node
+static const char* parser_add_str(parser_t* prs, const char* str, int len) {
+    return intern_get(prs->strs, intern_add(prs->strs, str, len));
+}
+
+uint32_t parser_add_ident(parser_t* prs, char* name, identkind_t kind) {
+    uint32_t key = intern_add(prs->syms, name, strlen(name));
+    parser_push_idents(prs, &(ident_t){
         .kind = kind,
-        .name = map_get(prs->syms, key),
+        .name = intern_get(prs->syms, key),
         .key = key
     }, 1);
     return key;
@@ -233,12 +301,12 @@ static void parser_selectors(parser_t* prs) {
 static void parser_qualident(parser_t* prs) {
     lexer_t* lex = prs->lex;
     if (lex->cur.kind == XOC_TOK_IDT) {
-        parser_type_set(prs, type_any(lex->cur.key));
+        parser_type_set(prs, parser_name(prs, lex->cur.key));
         lexer_next(lex);
         if (lex->cur.kind == XOC_TOK_COLONCOLON) {
             lexer_next(lex);
             if (lex->cur.kind == XOC_TOK_IDT) {
-                parser_type_set(prs, type_any(lex->cur.key));
+                parser_type_set(prs, type_any(prs->types, lex->cur.key));
             }
         }
     }
@@ -335,34 +403,34 @@ static void parser_maptype(parser_t* prs) {
 static void parser_identlist(parser_t* prs) {
     lexer_t* lex = prs->lex;
     if (lex->cur.kind == XOC_TOK_IDT) {
-        uint64_t key = lex->cur.key;
-        type_t* first = type_any(key);
+        uint32_t key = lex->cur.key;
+        parser_push_idents(prs, &(ident_t){
+            .kind = XOC_IDT_VAR,
+            .name = intern_get(prs->syms, key),
+            .key = key
+        }, 1);
+        type_t* first = type_dup(prs->types, type_idt(prs->types, &prs->idt_cur[pool_nsize(prs->idt_cur) - 1]));
         prs->cur = first;
         lexer_next(lex);
         if (lex->cur.kind == XOC_TOK_MUL) {
             lexer_next(lex);
         }
-        parser_push_idents(prs, &(ident_t){
-            .kind = XOC_IDT_VAR,
-            .name = map_get(prs->syms, key),
-            .key = key
-        }, 1);
         while (lex->cur.kind == XOC_TOK_COMMA) {
             lexer_next(lex);
             if (lex->cur.kind == XOC_TOK_IDT) {
                 key = lex->cur.key;
-                type_t* next = type_any(key);
+                parser_push_idents(prs, &(ident_t){
+                    .kind = XOC_IDT_VAR,
+                    .name = intern_get(prs->syms, key),
+                    .key = key
+                }, 1);
+                type_t* next = type_dup(prs->types, type_idt(prs->types, &prs->idt_cur[pool_nsize(prs->idt_cur) - 1]));
                 first->next = next;
                 first = next;
                 lexer_next(lex);
                 if (lex->cur.kind == XOC_TOK_MUL) {
                     lexer_next(lex);
                 }
-                parser_push_idents(prs, &(ident_t){
-                    .kind = XOC_IDT_VAR,
-                    .name = map_get(prs->syms, key),
-                    .key = key
-                }, 1);
             }
         }
     }
@@ -434,12 +502,12 @@ static void parser_signature(parser_t* prs) {
             if (lex->cur.kind == XOC_TOK_LPAR) {
                 lexer_next(lex);
                 parser_type(prs);
-                type_head = prs->cur;
-                type_t* type_first = prs->cur;
+                type_head = type_dup(prs->types, prs->cur);
+                type_t* type_first = type_head;
                 while (lex->cur.kind == XOC_TOK_COMMA) {
                     lexer_next(lex);
                     parser_type(prs);
-                    type_t* type_next = prs->cur;
+                    type_t* type_next = type_dup(prs->types, prs->cur);
                     type_first->next = type_next;
                     type_first = type_next;
                 }
@@ -721,44 +789,44 @@ static void parser_decl_const(parser_t* prs) {
     if (lex->cur.kind == XOC_TOK_CONST) {
         lexer_next(lex);
         if (lex->cur.kind == XOC_TOK_IDT) {
-            uint64_t key = lex->cur.key;
+            uint32_t key = lex->cur.key;
             lexer_next(lex);
             if (lex->cur.kind == XOC_TOK_MUL) {
                 lexer_next(lex);
             }
             lexer_eat(lex, XOC_TOK_EQ);
             parser_expr(prs);
-            parser_push_insts(prs, &(inst_t){
-                .label  = key,
-                .opc     = XOC_OP_REG,
-                .opr   = { [0] = prs->cur, [1] =  type_dvc(XOC_DVC_CPU) }
-            }, 1);
             parser_push_idents(prs, &(ident_t){
                 .kind = XOC_IDT_CONST,
-                .name = map_get(prs->syms, key),
+                .name = intern_get(prs->syms, key),
                 .key = key
             }, 1);
+            parser_push_insts(prs, &(inst_t){
+                .label  = key,
+                .opc     = XOC_OP_REG,
+                .opr   = { [0] = prs->cur, [1] =  type_dvc(prs->types, XOC_DVC_CPU), [2] = type_idt(prs->types, &prs->idt_cur[pool_nsize(prs->idt_cur) - 1]) }
+            }, 1);
         } else if (lex->cur.kind == XOC_TOK_LPAR) {
             lexer_next(lex);
             while (lex->cur.kind != XOC_TOK_RPAR) {
                 if (lex->cur.kind == XOC_TOK_IDT) {
-                    uint64_t key = lex->cur.key;
+                    uint32_t key = lex->cur.key;
                     lexer_next(lex);
                     if (lex->cur.kind == XOC_TOK_MUL) {
                         lexer_next(lex);
                     }
                     lexer_eat(lex, XOC_TOK_EQ);
                     parser_expr(prs);
-                    parser_push_insts(prs, &(inst_t){
-                        .label  = key,
-                        .opc     = XOC_OP_REG,
-                        .opr   = { [0] = prs->cur, [1] =  type_dvc(XOC_DVC_CPU) }
-                    }, 1);
                     parser_push_idents(prs, &(ident_t){
                         .kind = XOC_IDT_CONST,
-                        .name = map_get(prs->syms, key),
+                        .name = intern_get(prs->syms, key),
                         .key = key
                     }, 1);
+                    parser_push_insts(prs, &(inst_t){
+                        .label  = key,
+                        .opc     = XOC_OP_REG,
+                        .opr   = { [0] = prs->cur, [1] =  type_dvc(prs->types, XOC_DVC_CPU), [2] = type_idt(prs->types, &prs->idt_cur[pool_nsize(prs->idt_cur) - 1]) }
+                    }, 1);
                 }
                 lexer_eat(lex, XOC_TOK_SEMICOLON);
             }
@@ -766,43 +834,47 @@ static void parser_decl_const(parser_t* prs) {
     }
 }
 
+// typedidentlist '=' exprlist of a var: the names are in scope only after
+// their values, so `var x : i32 = x` in a block reads the outer x
+static void parser_decl_varspec(parser_t* prs) {
+    lexer_t* lex = prs->lex;
+    int lo = pool_nsize(prs->idt_cur);
+    parser_typedidentlist(prs);
+    type_t* tidt = prs->cur;
+    int hi = pool_nsize(prs->idt_cur);
+    if (prs->num_scope > 0) {
+        parser_scope_unbind(prs, lo);
+    }
+    lexer_eat(lex, XOC_TOK_EQ);
+    parser_exprlist(prs);
+    type_t* expr = prs->cur;
+    if (prs->num_scope > 0) {
+        for (int i = lo; i < hi; i++) {
+            parser_scope_bind(prs, i);
+        }
+    }
+    while(tidt && expr) {
+        parser_push_insts(prs, &(inst_t){
+            .label  = tidt->key,
+            .opc    = XOC_OP_REG,
+            .opr    = { [0] = expr, [1] =  type_dvc(prs->types, XOC_DVC_CPU), [2] = tidt }
+        }, 1);
+        tidt = tidt->next;
+        expr = expr->next;
+    }
+}
+
 // decl_fullvar => 'var' (typedidentlist '=' exprlist | '(' { typedidentlist '=' exprlist ';' } ')' )
 static void parser_decl_fullvar(parser_t* prs) {
     lexer_t* lex = prs->lex;
     if (lex->cur.kind == XOC_TOK_VAR) {
         lexer_next(lex);
         if (lex->cur.kind == XOC_TOK_IDT) {
-            parser_typedidentlist(prs);
-            type_t* tidt = prs->cur;
-            lexer_eat(lex, XOC_TOK_EQ);
-            parser_exprlist(prs);
-            type_t* expr = prs->cur;
-            while(tidt && expr) {
-                parser_push_insts(prs, &(inst_t){
-                    .label  = tidt->val.WPtr,
-                    .opc    = XOC_OP_REG,
-                    .opr    = { [0] = expr, [1] =  type_dvc(XOC_DVC_CPU) }
-                }, 1);
-                tidt = tidt->next;
-                expr = expr->next;
-            }
+            parser_decl_varspec(prs);
         } else if (lex->cur.kind == XOC_TOK_LPAR) {
             lexer_next(lex);
             while (lex->cur.kind != XOC_TOK_RPAR) {
-                parser_typedidentlist(prs);
-                type_t* tidt = prs->cur;
-                lexer_eat(lex, XOC_TOK_EQ);
-                parser_exprlist(prs);
-                type_t* expr = prs->cur;
-                while(tidt && expr) {
-                    parser_push_insts(prs, &(inst_t){
-                        .label  = tidt->val.WPtr,
-                        .opc    = XOC_OP_REG,
-                        .opr    = { [0] = expr, [1] =  type_dvc(XOC_DVC_CPU) }
-                    }, 1);
-                    tidt = tidt->next;
-                    expr = expr->next;
-                }
+                parser_decl_varspec(prs);
                 lexer_eat(lex, XOC_TOK_SEMICOLON);
             }
         }
@@ -840,23 +912,26 @@ static void parser_decl_fn(parser_t* prs) {
             lexer_eat(lex, XOC_TOK_RPAR);
         }
         if (lex->cur.kind == XOC_TOK_IDT) {
-            uint64_t key = lex->cur.key;
-            type_t* idt = type_any(key);
+            uint32_t key = lex->cur.key;
+            type_t* idt = type_any(prs->types, key);
             lexer_next(lex);
             if (lex->cur.kind == XOC_TOK_MUL) {
                 lexer_next(lex);
             }
-            parser_signature(prs);
-            type_t* proto = prs->cur;
+            // The name goes in the enclosing scope, the parameters in their own
+            int at = pool_nsize(prs->idt_cur);
             parser_push_idents(prs, &(ident_t){
                 .kind = XOC_IDT_VAR,
-                .name = map_get(prs->syms, key),
-                .key = key,
-                .proto = type_fn(key, proto)
+                .name = intern_get(prs->syms, key),
+                .key = key
             }, 1);
+            parser_scope_open(prs);
+            parser_signature(prs);
+            prs->idt_cur[at].proto = type_fn(prs->types, key, prs->cur);
             if (lex->cur.kind == XOC_TOK_LBRACE) {
                 parser_block(prs);
             }
+            parser_scope_close(prs);
         }
     }
 }
@@ -895,96 +970,216 @@ static void parser_factor(parser_t* prs) {
         lex->cur.kind == XOC_TOK_CHAR_LIT ||
         lex->cur.kind == XOC_TOK_STR_LIT ||
         lex->cur.kind == XOC_TOK_IDT) {
-        tokenkind_t tk = lex->cur.kind;
-        lexer_eat(lex, tk);
-        switch (tk) {
-            case XOC_TOK_INT_LIT: parser_type_set(prs, type_i64(lex->cur.Int)); break;
-            case XOC_TOK_REAL_LIT: parser_type_set(prs, type_f64(lex->cur.Real)); break;
-            case XOC_TOK_CHAR_LIT: parser_type_set(prs, type_char(lex->cur.Int)); break;
-            case XOC_TOK_STR_LIT: parser_type_set(prs, type_str(lex->cur.key)); break;
-            case XOC_TOK_IDT: parser_type_set(prs, type_any(lex->cur.key)); break;
-            default: prs->cur = parser_type_set(prs, type_alc(XOC_TYPE_NONE)); break;
+        // The payload is read from a copy, eating the token moves `cur` on
+        token_t tok = lex->cur;
+        lexer_eat(lex, tok.kind);
+        switch (tok.kind) {
+            case XOC_TOK_INT_LIT: parser_type_set(prs, type_i64(prs->types, tok.Int)); break;
+            case XOC_TOK_REAL_LIT: parser_type_set(prs, type_f64(prs->types, tok.Real)); break;
+            case XOC_TOK_CHAR_LIT: parser_type_set(prs, type_char(prs->types, tok.Int)); break;
+            case XOC_TOK_STR_LIT: parser_type_set(prs, type_str(prs->types, (uintptr_t)parser_add_str(prs, tok.Str, tok.len))); break;
+            case XOC_TOK_IDT: {
+                ident_t* idt = parser_get_ident(prs, tok.key);
+                if (idt) {
+                    idt->is_used = true;
+                }
+                parser_type_set(prs, parser_name(prs, tok.key));
+                break;
+            }
+            default: prs->cur = parser_type_set(prs, type_intern(prs->types, &(type_t){ .kind = XOC_TYPE_NONE })); break;
         }
     } else if (lex->cur.kind == XOC_TOK_PLUS || 
         lex->cur.kind == XOC_TOK_MINUS || 
         lex->cur.kind == XOC_TOK_NOT ||
         lex->cur.kind == XOC_TOK_XOR ||
         lex->cur.kind == XOC_TOK_AND) {
-        type_t* sym = type_tok(lex->prev.kind);
+        type_t* sym = type_tok(prs->types, lex->prev.kind);
         lexer_next(lex);
         parser_factor(prs);
         parser_push_insts(prs, &(inst_t){
             .opc     = XOC_OP_UNARY,
-            .opr   = { [0] = sym, [1] = type_tmp(prs->tid), [2] = prs->cur }
+            .opr   = { [0] = sym, [1] = type_tmp(prs->types, prs->tid), [2] = prs->cur }
         }, 1);
-        prs->cur = type_tmp(prs->tid);
+        prs->cur = type_tmp(prs->types, prs->tid);
         prs->tid++;
     } else if (lex->cur.kind == XOC_TOK_LPAR) {
         lexer_eat(lex, XOC_TOK_LPAR);
         parser_expr(prs);
         lexer_eat(lex, XOC_TOK_RPAR);
+    } else {
+        // Leave an operand anyway, an operator must not pick up the last
+        // expression's value or none at all
+        prs->log->fmt(prs->info, "Expect an operand, got `%s`", lexer_mnemonic(lex->cur.kind));
+        parser_type_set(prs, type_intern(prs->types, &(type_t){ .kind = XOC_TYPE_NONE }));
+    }
+}
+
+// Binding power of each binary operator, higher binds tighter; 0 is not
+// a binary operator, which also ends an expression
+static const uint8_t parser_prec_tbl[XOC_TOK_EOF + 1] = {
+    [XOC_TOK_MUL] = 5, [XOC_TOK_DIV] = 5, [XOC_TOK_MOD] = 5,
+    [XOC_TOK_SHL] = 5, [XOC_TOK_SHR] = 5, [XOC_TOK_AND] = 5,
+
+    [XOC_TOK_PLUS] = 4, [XOC_TOK_MINUS] = 4, [XOC_TOK_OR] = 4, [XOC_TOK_XOR] = 4,
+
+    [XOC_TOK_EQEQ] = 3, [XOC_TOK_NOTEQ] = 3, [XOC_TOK_LESS] = 3,
+    [XOC_TOK_LESSEQ] = 3, [XOC_TOK_GREATER] = 3, [XOC_TOK_GREATEREQ] = 3,
+
+    [XOC_TOK_ANDAND] = 2,
+    [XOC_TOK_OROR] = 1,
+};
+
+// Start a new block at a label, where jumps to it land
+static void parser_blk_label(parser_t* prs, uint32_t lbl) {
+    inst_t* new_blk = parser_blk_alc(prs, 1);
+    new_blk[0].label = lbl;
+}
+
+// Point the jumps to `from` pushed since block `bid` at `to` instead
+static void parser_blk_retarget(parser_t* prs, int bid, uint32_t from, uint32_t to) {
+    type_t* org = type_lbl(prs->types, from);
+    inst_t* blk;
+    for (; (blk = (inst_t*)pool_nat(prs->blks, bid)); bid++) {
+        for (int i = 0; i < pool_nsize(blk); i++) {
+            if (blk[i].opr[0] == org) {
+                blk[i].opr[0] = type_lbl(prs->types, to);
+            }
+        }
     }
 }
 
-// term[n-1] => term[n-1] {(
-//       0 '*' | '/' | '%' | '<<' | '>>' | '&' |
-//       1 '+' | '-' | '|' | '~' |
-//       2 '==' | '!=' | '<' | '<=' | '>' | '>='
-//       3 '&&' |
-//       4 '||') term[n-1]}
-static void parser_term_n(parser_t* prs, int n) {
+// dst = val != 0, the 0 or 1 a && or || chain yields
+static void parser_push_truth(parser_t* prs, type_t* dst, type_t* val) {
+    parser_push_insts(prs, &(inst_t){
+        .opc     = XOC_OP_BINARY,
+        .opr   = { [0] = type_tok(prs->types, XOC_TOK_NOTEQ), [1] = dst, [2] = val, [3] = type_i64(prs->types, 0) }
+    }, 1);
+}
+
+// binary[min] => factor { op binary[prec(op)] }, for every op with prec(op) > min
+//      5 '*' | '/' | '%' | '<<' | '>>' | '&'
+//      4 '+' | '-' | '|' | '~'
+//      3 '==' | '!=' | '<' | '<=' | '>' | '>='
+//      2 '&&'
+//      1 '||'
+// The right operand only takes operators binding tighter than op, and the
+// loop folds the rest into the left, so chains are left associative.
+// A chain of && or || short-circuits: each operand's truth goes to one temp
+// and the first that decides the chain jumps past the rest.
+static void parser_binary(parser_t* prs, int min) {
     lexer_t* lex = prs->lex;
-    type_t *lhs, *rhs, *sym;
-    int level = n;
-    if (n == 0) {
-        parser_factor(prs);
-        lhs = prs->cur;
-        level = parser_term_level(prs, lex->cur.kind);
-        if(level == 0) {
-            sym = type_tok(lex->prev.kind);
+    parser_factor(prs);
+    tokenkind_t sc_tk = XOC_TOK_NONE;
+    type_t* sc_tmp = NULL;
+    uint32_t sc_lbl = 0;
+    int prec;
+    while ((prec = parser_prec_tbl[lex->cur.kind]) > min) {
+        tokenkind_t tk = lex->cur.kind;
+        if (sc_lbl && tk != sc_tk) {
+            parser_blk_label(prs, sc_lbl);
+            sc_lbl = 0;
+        }
+        if (tk == XOC_TOK_ANDAND || tk == XOC_TOK_OROR) {
+            if (!sc_lbl) {
+                // The chain just closed already holds 0 or 1
+                if (prs->cur != sc_tmp) {
+                    sc_tmp = type_tmp(prs->types, prs->tid++);
+                    parser_push_truth(prs, sc_tmp, prs->cur);
+                }
+                sc_tk = tk;
+                sc_lbl = parser_add_label(prs, NULL);
+            }
+            parser_push_insts(prs, &(inst_t){
+                .opc     = tk == XOC_TOK_ANDAND ? XOC_OP_JMP_IFN : XOC_OP_JMP_IF,
+                .opr   = { [0] = type_lbl(prs->types, sc_lbl), [1] = sc_tmp }
+            }, 1);
             lexer_next(lex);
-            parser_factor(prs);
-            rhs = prs->cur;
-        } else {
-            return;
+            parser_binary(prs, prec);
+            parser_push_truth(prs, sc_tmp, prs->cur);
+            prs->cur = sc_tmp;
+            continue;
         }
-    } else if(n > 0 && n < 5) {
-        parser_term_n(prs, n-1);
-        lhs = prs->cur;
-        level = parser_term_level(prs, lex->cur.kind);
-        if(level == n-1) {
-            sym = type_tok(lex->prev.kind);
+        type_t* lhs = prs->cur;
+        type_t* sym = type_tok(prs->types, tk);
+        lexer_next(lex);
+        parser_binary(prs, prec);
+        type_t* rhs = prs->cur;
+        parser_push_insts(prs, &(inst_t){
+            .opc     = XOC_OP_BINARY,
+            .opr   = { [0] = sym, [1] = type_tmp(prs->types, prs->tid), [2] = lhs, [3] = rhs }
+        }, 1);
+        prs->cur = type_tmp(prs->types, prs->tid);
+        prs->tid++;
+    }
+    if (sc_lbl) {
+        parser_blk_label(prs, sc_lbl);
+    }
+}
+
+// cond => conj { '||' conj }, conj => binary[2] { '&&' binary[2] }
+// A condition as control flow: it jumps to `lbl_false` when false and falls
+// through when true, each operand testing its own value. Whether an operand
+// ends its conjunction or the whole condition is only known at the token
+// after it, so that is where its jump is picked:
+//      && follows      to the conjunction's own false exit, the next disjunct
+//      || follows      to the true exit past the condition
+//      last            to `lbl_false`, and so is the conjunction's false exit
+static void parser_cond(parser_t* prs, uint32_t lbl_false) {
+    lexer_t* lex = prs->lex;
+    uint32_t lbl_true = 0;
+    for (;;) {
+        int org_bid = prs->bid - 1;
+        uint32_t lbl_next = 0;
+        for (;;) {
+            parser_binary(prs, parser_prec_tbl[XOC_TOK_ANDAND]);
+            opcode_t opc = XOC_OP_JMP_IFN;
+            uint32_t lbl = lbl_false;
+            if (lex->cur.kind == XOC_TOK_ANDAND) {
+                lbl = lbl_next = lbl_next ? lbl_next : parser_add_label(prs, NULL);
+            } else if (lex->cur.kind == XOC_TOK_OROR) {
+                opc = XOC_OP_JMP_IF;
+                lbl = lbl_true = lbl_true ? lbl_true : parser_add_label(prs, NULL);
+            }
+            parser_push_insts(prs, &(inst_t){
+                .opc     = opc,
+                .opr   = { [0] = type_lbl(prs->types, lbl), [1] = prs->cur }
+            }, 1);
+            if (lex->cur.kind != XOC_TOK_ANDAND) {
+                break;
+            }
             lexer_next(lex);
-            parser_term_n(prs, n-1);
-            rhs = prs->cur;
-        } else {
-            return;
         }
-    } else {
-        return;
+        if (lex->cur.kind != XOC_TOK_OROR) {
+            if (lbl_next) {
+                parser_blk_retarget(prs, org_bid, lbl_next, lbl_false);
+            }
+            break;
+        }
+        if (lbl_next) {
+            parser_blk_label(prs, lbl_next);
+        }
+        lexer_next(lex);
+    }
+    if (lbl_true) {
+        parser_blk_label(prs, lbl_true);
     }
-    parser_push_insts(prs, &(inst_t){
-        .opc     = XOC_OP_BINARY,
-        .opr   = { [0] = sym, [1] = type_tmp(prs->tid), [2] = lhs, [3] = rhs }
-    }, 1);
-    prs->cur = type_tmp(prs->tid);
-    prs->tid++;
 }
 
-// expr => term 
+// expr => binary[0]
 static void parser_expr(parser_t* prs) {
-    parser_term_n(prs, 4);
+    parser_binary(prs, 0);
 }
 
 // exprlist => expr {',' expr}
 static void parser_exprlist(parser_t* prs) {
     lexer_t* lex = prs->lex;
     parser_expr(prs);
-    type_t* first = prs->cur, *head = prs->cur;
+    // Operands are shared, so the list links copies of them
+    type_t* first = type_dup(prs->types, prs->cur), *head = first;
     while (lex->cur.kind == XOC_TOK_COMMA) {
         lexer_next(lex);
         parser_expr(prs);
-        type_t* next = prs->cur;
+        type_t* next = type_dup(prs->types, prs->cur);
         first->next = next;
         first = next;
     }
@@ -1031,18 +1226,14 @@ static void parser_stmt_simple(parser_t* prs) {
     }
 }
 
-// stmt_if = 'if' expr block [ 'else' ( stmt_if | block ) ]
+// stmt_if = 'if' cond block [ 'else' ( stmt_if | block ) ]
 static void parser_stmt_if(parser_t* prs) {
     lexer_t* lex = prs->lex;
     if (lex->cur.kind == XOC_TOK_IF) {
         lexer_eat(lex, XOC_TOK_IF);
-        parser_expr(prs);
         inst_t *new_blk = NULL;
-        uint64_t new_lbl = parser_add_label(prs, NULL);
-        parser_push_insts(prs, &(inst_t){
-            .opc     = XOC_OP_JMP_IFN,
-            .opr   = { [0] = type_lbl(new_lbl), [1] = prs->cur }
-        }, 1);
+        uint32_t new_lbl = parser_add_label(prs, NULL);
+        parser_cond(prs, new_lbl);
         parser_block(prs);
         if (lex->cur.kind == XOC_TOK_ELSE) {
             lexer_eat(lex, XOC_TOK_ELSE);
@@ -1061,12 +1252,12 @@ static void parser_stmt_if(parser_t* prs) {
             new_bid = prs->bid;
             parser_blk_swc(prs, org_bid - 1);
             inst_t* org_last = &prs->blk_cur[prs->iid - 1];
-            if(org_last->opc == XOC_OP_JMP) {
-                org_last->opr[0] = type_lbl(new_lbl);
+            if(prs->iid > 0 && org_last->opc == XOC_OP_JMP) {
+                org_last->opr[0] = type_lbl(prs->types, new_lbl);
             } else {
                 parser_push_insts(prs, &(inst_t){
                     .opc     = XOC_OP_JMP,
-                    .opr   = { [0] = type_lbl(new_lbl) }
+                    .opr   = { [0] = type_lbl(prs->types, new_lbl) }
                 }, 1);
             }
             parser_blk_swc(prs, new_bid - 1);
@@ -1078,6 +1269,11 @@ static void parser_stmt_if(parser_t* prs) {
 }
 
 // stmt_switch => 'switch' [ decl_shortvar ';' ] expr '{' { { 'case' expr {',' expr} ':' stmtlist } ['default' ':' stmtlist ] '}'
+// Clauses run in source order: a case tests its values one by one and a
+// body that does not break runs into the next clause's tests. When every
+// body but the last breaks, a default can only come last and no value costs
+// code, those tests are dropped for one SWITCH at the head, which lists
+// each value with the label of its body for gen_lower to dispatch on.
 static void parser_stmt_switch(parser_t* prs) {
     lexer_t* lex = prs->lex;
     if (lex->cur.kind == XOC_TOK_SWITCH) {
@@ -1085,55 +1281,86 @@ static void parser_stmt_switch(parser_t* prs) {
         parser_expr(prs);
         type_t* lhs = prs->cur;
         lexer_eat(lex, XOC_TOK_LBRACE);
-        unsigned trg_lbl = parser_add_label(prs, NULL);
+        int head_bid = prs->bid - 1;
+        uint32_t trg_lbl = parser_add_label(prs, NULL);
+        uint32_t dft_lbl = trg_lbl;
+        type_t *cases = NULL, **tail = &cases;
+        // Block holding each case's tests, they end it
+        int* test_bids = NULL;
+        int num_test = 0;
+        bool is_dispatch = true, is_open = false;
         while (lex->cur.kind == XOC_TOK_CASE || lex->cur.kind == XOC_TOK_DEFAULT) {
-            int org_bid = prs->bid, new_bid;
+            uint32_t body_lbl = parser_add_label(prs, NULL);
+            uint32_t new_lbl = 0;
+            // The one before fell into this clause, or a default came before
+            is_dispatch = is_dispatch && !is_open;
             prs->is_break = false;
             if (lex->cur.kind == XOC_TOK_DEFAULT) {
                 lexer_eat(lex, XOC_TOK_DEFAULT);
-                lexer_eat(lex, XOC_TOK_COLON);
-                parser_stmtlist(prs);
+                dft_lbl = body_lbl;
             } else if (lex->cur.kind == XOC_TOK_CASE) {
                 lexer_eat(lex, XOC_TOK_CASE);
-                parser_expr(prs);
-                type_t* rhs = prs->cur;
-                while (lex->cur.kind == XOC_TOK_COMMA) {
-                    lexer_next(lex);
+                test_bids = (int*)realloc(test_bids, (num_test + 1) * sizeof(int));
+                test_bids[num_test++] = prs->bid - 1;
+                new_lbl = parser_add_label(prs, NULL);
+                // Every value but the last jumps into the body on a match,
+                // the last one past it on a miss
+                for (;;) {
                     parser_expr(prs);
-                    rhs = prs->cur;
-                    parser_push_insts(prs, (inst_t[]){{
-                            .opc     = XOC_OP_BINARY,
-                            .opr   = { [0] = type_tok(XOC_TOK_EQEQ), [1] = type_tmp(prs->tid), [2] = lhs, [3] = rhs }
-                        }, {
-                            .opc     = XOC_OP_BINARY,
-                            .opr   = { [0] = type_tok(XOC_TOK_OROR), [1] = type_tmp(prs->tid + 1), [2] = lhs, [3] = rhs }
-                        }
-                    }, 2);
-                    prs->tid += 2;
+                    is_dispatch = is_dispatch && prs->cur->kind != XOC_TYPE_TMP;
+                    *tail = type_dup(prs->types, type_lbl(prs->types, body_lbl));
+                    (*tail)->base = prs->cur;
+                    tail = &(*tail)->next;
+                    if (lex->cur.kind != XOC_TOK_COMMA) {
+                        break;
+                    }
+                    parser_push_insts(prs, &(inst_t){
+                        .opc     = XOC_OP_JMP_IFEQ,
+                        .opr   = { [0] = type_lbl(prs->types, body_lbl), [1] = lhs, [2] = prs->cur }
+                    }, 1);
+                    lexer_next(lex);
                 }
-                lexer_eat(lex, XOC_TOK_COLON);
-                uint64_t new_lbl = parser_add_label(prs, NULL);
                 parser_push_insts(prs, &(inst_t){
                     .opc     = XOC_OP_JMP_IFNE,
-                    .opr   = { [0] = type_lbl(new_lbl), [1] = lhs, [2] = rhs }
+                    .opr   = { [0] = type_lbl(prs->types, new_lbl), [1] = lhs, [2] = prs->cur }
                 }, 1);
-                parser_stmtlist(prs);
-                inst_t* new_blk = parser_blk_alc(prs, 1);
-                new_blk[0].label = new_lbl;   
             }
-            new_bid = prs->bid;
-            if(prs->is_break) {
-                parser_blk_swc(prs, org_bid - 1);
+            lexer_eat(lex, XOC_TOK_COLON);
+            parser_blk_label(prs, body_lbl);
+            parser_scope_open(prs);
+            parser_stmtlist(prs);
+            parser_scope_close(prs);
+            if (prs->is_break) {
                 parser_push_insts(prs, &(inst_t){
                     .opc     = XOC_OP_JMP,
-                    .opr   = { [0] = type_lbl(trg_lbl) }
+                    .opr   = { [0] = type_lbl(prs->types, trg_lbl) }
                 }, 1);
-                parser_blk_swc(prs, new_bid - 1);
+            }
+            is_open = !prs->is_break || dft_lbl != trg_lbl;
+            if (new_lbl) {
+                parser_blk_label(prs, new_lbl);
             }
         }
         lexer_eat(lex, XOC_TOK_RBRACE);
-        inst_t* new_blk = parser_blk_alc(prs, 1);
-        new_blk[0].label = trg_lbl;
+        if (is_dispatch && cases) {
+            // Values cost no code, so the tests are the last insts of their
+            // block, one per value of the case
+            type_t* cas = cases;
+            for (int i = 0; i < num_test; i++) {
+                inst_t* blk = (inst_t*)pool_nat(prs->blks, test_bids[i]);
+                for (uint64_t lbl = cas->val.WPtr; cas && cas->val.WPtr == lbl; cas = cas->next) {
+                    pool_nsize(blk)--;
+                }
+            }
+            parser_blk_swc(prs, head_bid);
+            parser_push_insts(prs, &(inst_t){
+                .opc     = XOC_OP_SWITCH,
+                .opr   = { [0] = type_lbl(prs->types, dft_lbl), [1] = lhs, [2] = cases }
+            }, 1);
+            parser_blk_swc(prs, prs->bid - 1);
+        }
+        free(test_bids);
+        parser_blk_label(prs, trg_lbl);
     }
 }
 
@@ -1170,8 +1397,10 @@ static void parser_stmt_for(parser_t* prs) {
     lexer_t* lex = prs->lex;
     if (lex->cur.kind == XOC_TOK_FOR) {
         lexer_eat(lex, XOC_TOK_FOR);
+        parser_scope_open(prs);
         parser_forheader(prs);
         parser_block(prs);
+        parser_scope_close(prs);
     }
 }
 
@@ -1228,12 +1457,192 @@ static void parser_block(parser_t* prs) {
     lexer_t* lex = prs->lex;
     if (lex->cur.kind == XOC_TOK_LBRACE) {
         lexer_next(lex);
+        parser_scope_open(prs);
         parser_stmtlist(prs);
+        parser_scope_close(prs);
         lexer_eat(lex, XOC_TOK_RBRACE);
     }
 }
 
-void parser_init(parser_t* prs, lexer_t* lex, pool_t* blks, pool_t* idts, map_t* syms) {
+// Index of the current token in the token buffer
+static int parser_tok_at(parser_t* prs) {
+    tokbuf_t* toks = prs->lex->toks;
+    return toks ? toks->pos - 1 : -1;
+}
+
+static void parser_unit_shift(unit_t* unit, int dtok, int dblk, int didt) {
+    unit->tok_lo += dtok;
+    unit->tok_hi += dtok;
+    unit->blk_lo += dblk;
+    unit->blk_hi += dblk;
+    unit->idt_lo += didt;
+    unit->idt_hi += didt;
+}
+
+// The i-th unit, with the shift of those past the gap applied
+unit_t parser_unit_at(parser_t* prs, int i) {
+    if (i < prs->unit_gap) {
+        return prs->units[i];
+    }
+    unit_t unit = prs->units[i + prs->cap_unit - prs->num_unit];
+    parser_unit_shift(&unit, prs->shift_tok, prs->shift_blk, prs->shift_idt);
+    return unit;
+}
+
+// Move the gap in front of unit `at`, units crossing it take on or give
+// back the shift
+static void parser_unit_gap(parser_t* prs, int at) {
+    int len = prs->cap_unit - prs->num_unit;
+    while (prs->unit_gap > at) {
+        unit_t* unit = &prs->units[--prs->unit_gap + len];
+        *unit = prs->units[prs->unit_gap];
+        parser_unit_shift(unit, -prs->shift_tok, -prs->shift_blk, -prs->shift_idt);
+    }
+    while (prs->unit_gap < at) {
+        unit_t* unit = &prs->units[prs->unit_gap];
+        *unit = prs->units[prs->unit_gap++ + len];
+        parser_unit_shift(unit, prs->shift_tok, prs->shift_blk, prs->shift_idt);
+    }
+}
+
+// Units go in at the gap, which is the end outside parser_edit
+static void parser_unit_push(parser_t* prs, unit_t* unit) {
+    if (prs->num_unit == prs->cap_unit) {
+        int num = prs->num_unit - prs->unit_gap, cap = prs->cap_unit ? prs->cap_unit * 2 : 16;
+        prs->units = (unit_t*)realloc(prs->units, cap * sizeof(unit_t));
+        memmove(prs->units + cap - num, prs->units + prs->cap_unit - num, num * sizeof(unit_t));
+        prs->cap_unit = cap;
+    }
+    prs->units[prs->unit_gap++] = *unit;
+    prs->num_unit++;
+}
+
+// unit => { ';' | EOL } stmt
+static bool parser_unit(parser_t* prs, unit_t* unit) {
+    lexer_t* lex = prs->lex;
+    unit->tok_lo = parser_tok_at(prs);
+    unit->blk_lo = prs->blks->size;
+    unit->idt_lo = pool_nsize(prs->idt_cur);
+    while (lex->cur.kind == XOC_TOK_SEMICOLON || lex->cur.kind == XOC_TOK_EOLI) {
+        lexer_next(lex);
+    }
+    if (lex->cur.kind == XOC_TOK_EOF || lex->cur.kind == XOC_TOK_NONE) {
+        return false;
+    }
+    // Each unit starts its own block, so its code can be replaced alone
+    int off = lex->cur.off;
+    parser_blk_alc(prs, 1);
+    parser_stmt(prs);
+    if (lex->cur.off == off) {
+        prs->log->fmt(prs->info, "Unexpected token `%s` at top level", lexer_mnemonic(lex->cur.kind));
+        lexer_next(lex);
+    }
+    unit->tok_hi = parser_tok_at(prs);
+    unit->blk_hi = prs->blks->size;
+    unit->idt_hi = pool_nsize(prs->idt_cur);
+    return true;
+}
+
+// module => { unit } EOF
+void parser_module(parser_t* prs) {
+    unit_t unit;
+    prs->num_unit = 0;
+    while (parser_unit(prs, &unit)) {
+        parser_unit_push(prs, &unit);
+    }
+}
+
+// Reparse a module after lexer_edit replaced `num_old` tokens at `lo` with
+// `num_new`. A statement looks one token past its end, so reparsing starts
+// at the unit before the one holding `lo`. It stops as soon as a unit ends
+// past the edit where an old unit began: that unit and all after it keep
+// their blocks and idents. Units keep a gap where reparsing starts, and
+// those past it take the change in tokens, blocks and idents as one pending
+// shift instead of being rewritten. Blocks and idents of the units after
+// the edit still move when it changes how many the reparsed units hold.
+void parser_edit(parser_t* prs, int lo, int num_old, int num_new) {
+    lexer_t* lex = prs->lex;
+    tokbuf_t* toks = lex->toks;
+    if (!toks || lo < 0) {
+        return;
+    }
+    // 1. Last unit starting before the edit
+    int num = prs->num_unit;
+    int a = 0, hi = num;
+    while (a < hi) {
+        int mid = (a + hi) / 2;
+        if (parser_unit_at(prs, mid).tok_lo < lo) {
+            a = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    a = a > 0 ? a - 1 : 0;
+    parser_unit_gap(prs, a);
+    unit_t first = num ? parser_unit_at(prs, a) : (unit_t){ 0 };
+
+    // 2. Parse new units into the gap until they meet an old boundary
+    int dtok = num_new - num_old;
+    int blk_mark = prs->blks->size;
+    int idt_mark = pool_nsize(prs->idt_cur);
+    int b = 1;
+    bool is_sync = false;
+    unit_t unit, last = first;
+    toks->pos = first.tok_lo;
+    lexer_next(lex);
+    prs->is_edit = true;
+    while (!is_sync && parser_unit(prs, &unit)) {
+        parser_unit_push(prs, &unit);
+        if (unit.tok_hi >= lo + num_new) {
+            int num_rest = prs->num_unit - prs->unit_gap;
+            while (b < num_rest && parser_unit_at(prs, prs->unit_gap + b).tok_lo < unit.tok_hi - dtok) {
+                b++;
+            }
+            is_sync = b < num_rest && parser_unit_at(prs, prs->unit_gap + b).tok_lo == unit.tok_hi - dtok;
+        }
+    }
+    b = is_sync ? b : prs->num_unit - prs->unit_gap;
+    last = b > 0 ? parser_unit_at(prs, prs->unit_gap + b - 1) : last;
+    prs->is_edit = false;
+
+    // 3. Move the new blocks and idents over the replaced ones
+    int blk_lo = num ? first.blk_lo : blk_mark;
+    int blk_hi = num ? last.blk_hi : blk_mark;
+    int idt_lo = num ? first.idt_lo : idt_mark;
+    int idt_hi = num ? last.idt_hi : idt_mark;
+    int dblk = (prs->blks->size - blk_mark) - (blk_hi - blk_lo);
+    int didt = (pool_nsize(prs->idt_cur) - idt_mark) - (idt_hi - idt_lo);
+    // Where the new units declare the same names as the old, their module
+    // bindings carry over as they are; otherwise they are all rebuilt
+    bool is_same = didt == 0;
+    for (int i = 0; is_same && i < idt_hi - idt_lo; i++) {
+        ident_t* old = &prs->idt_cur[idt_lo + i], *new = &prs->idt_cur[idt_mark + i];
+        is_same = old->key == new->key && old->kind == new->kind && old->is_global == new->is_global;
+        if (new->is_global) {
+            new->shadow = old->shadow;
+        }
+    }
+    pool_nsplice(prs->blks, blk_lo, blk_hi - blk_lo, blk_mark);
+    pool_nsize(prs->idt_cur) = xoc_splice(prs->idt_cur, sizeof(ident_t), idt_lo, idt_hi - idt_lo, idt_mark, pool_nsize(prs->idt_cur));
+    for (int i = a; i < prs->unit_gap; i++) {
+        parser_unit_shift(&prs->units[i], 0, blk_lo - blk_mark, idt_lo - idt_mark);
+    }
+
+    // 4. Drop the replaced units behind the gap, the rest take the shift
+    prs->num_unit -= b;
+    prs->shift_tok += dtok;
+    prs->shift_blk += dblk;
+    prs->shift_idt += didt;
+    if (!is_same) {
+        parser_scope_rebind(prs);
+    }
+    prs->bid = prs->blks->size;
+    parser_blk_swc(prs, prs->bid - 1);
+    toks->pos = toks->size - 1;
+    lexer_next(lex);
+}
+
+void parser_init(parser_t* prs, lexer_t* lex, pool_t* blks, pool_t* idts, intern_t* syms, intern_t* strs, typetbl_t* types) {
     prs->tid = 0;
     prs->iid = 0;
     prs->bid = 0;
@@ -1241,12 +1650,23 @@ void parser_init(parser_t* prs, lexer_t* lex, pool_t* blks, pool_t* idts, map_t*
     prs->blks = blks;
     prs->idts = idts;
     prs->syms = syms;
+    prs->strs = strs;
+    prs->types = types;
     prs->lex = lex;
     prs->info = lex->info;
     prs->log = lex->log;
     prs->cur = NULL;
     prs->blk_cur = NULL;
     prs->idt_cur = NULL;
+    prs->idt_top = NULL;
+    prs->cap_top = 0;
+    prs->num_scope = 0;
+    prs->num_local = 0;
+    prs->is_edit = false;
+    prs->units = NULL;
+    prs->num_unit = prs->cap_unit = 0;
+    prs->unit_gap = 0;
+    prs->shift_tok = prs->shift_blk = prs->shift_idt = 0;
     parser_blk_alc(prs, 1);
     parser_idt_alc(prs, 1);
 }
@@ -1254,26 +1674,35 @@ void parser_init(parser_t* prs, lexer_t* lex, pool_t* blks, pool_t* idts, map_t*
 
 
 void parser_free(parser_t* prs) {
+    free(prs->idt_top);
+    prs->idt_top = NULL;
+    prs->cap_top = 0;
+    free(prs->units);
+    prs->units = NULL;
+    prs->num_unit = prs->cap_unit = prs->unit_gap = 0;
+    if (!log_on(prs->log, XOC_LOG_PARSER, XOC_LOG_DEBUG)) {
+        return;
+    }
     char buf[360];
     int n = 0;
     inst_t* blk = (inst_t*)pool_nat(prs->blks, n);
-    printf("\n\n");
+    prs->log->fmt(NULL, "\n\n");
 
     // Print the idents
-    printf("\n╭────────────[Ident Symbol: %4d/%-4d]────────────╮", pool_nsize(prs->idt_cur), pool_ncap(prs->idt_cur));
+    prs->log->fmt(NULL, "\n╭────────────[Ident Symbol: %4d/%-4d]────────────╮", pool_nsize(prs->idt_cur), pool_ncap(prs->idt_cur));
     for(int i = 0; i < pool_nsize(prs->idt_cur); i++) {
         ident_t* idt = &prs->idt_cur[i];
         char idt_buf[64];
         ident_info(idt, idt_buf, 64);
-        printf("\n%s", idt_buf);
+        prs->log->fmt(NULL, "\n%s", idt_buf);
     }
-    printf("\n╰─────────────────────────────────────────────────╯\n");
+    prs->log->fmt(NULL, "\n╰─────────────────────────────────────────────────╯\n");
 
     // Print the blocks
     while (blk) {
-        printf("\n╭───────────[ID: #%-3d Insts: %4d/%-4d]───────────╮", n, pool_nsize(blk), pool_ncap(blk));
-        blk_info(blk, buf, 360, prs->syms);
-        printf("\n╰─────────────────────────────────────────────────╯\n");
+        prs->log->fmt(NULL, "\n╭───────────[ID: #%-3d Insts: %4d/%-4d]───────────╮", n, pool_nsize(blk), pool_ncap(blk));
+        blk_info(blk, buf, 360, prs->syms, prs->log);
+        prs->log->fmt(NULL, "\n╰─────────────────────────────────────────────────╯\n");
         blk = (inst_t*)pool_nat(prs->blks, ++n);
     }
 }
\ No newline at end of file
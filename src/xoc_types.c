@@ -36,6 +36,94 @@ static const char* type_mnemonic_tbl[] = {
     [XOC_TYPE_FN]       = "fn",
 };
 
+static const char* opcode_mnemonic_tbl[] = {
+    [XOC_OP_NOP]                   = "NOP",
+    [XOC_OP_REG]                   = "REG",
+    [XOC_OP_PUSH]                  = "PUSH",
+    [XOC_OP_PUSH_ZERO]             = "PUSH_ZERO",
+    [XOC_OP_PUSH_LOCAL_PTR]        = "PUSH_LOCAL_PTR",
+    [XOC_OP_PUSH_LOCAL_PTR_ZERO]   = "PUSH_LOCAL_PTR_ZERO",
+    [XOC_OP_PUSH_LOCAL]            = "PUSH_LOCAL",
+    [XOC_OP_PUSH_REG]              = "PUSH_REG",
+    [XOC_OP_PUSH_UPVALUE]          = "PUSH_UPVALUE",
+    [XOC_OP_POP]                   = "POP",
+    [XOC_OP_POP_REG]               = "POP_REG",
+    [XOC_OP_DUP]                   = "DUP",
+    [XOC_OP_SWAP]                  = "SWAP",
+    [XOC_OP_ZERO]                  = "ZERO",
+    [XOC_OP_DEREF]                 = "DEREF",
+    [XOC_OP_ASSIGN]                = "ASSIGN",
+    [XOC_OP_ASSIGN_PARAM]          = "ASSIGN_PARAM",
+    [XOC_OP_CHANGE_REF_CNT]        = "CHANGE_REF_CNT",
+    [XOC_OP_CHANGE_REF_CNT_GLOBAL] = "CHANGE_REF_CNT_GLOBAL",
+    [XOC_OP_CHANGE_REF_CNT_LOCAL]  = "CHANGE_REF_CNT_LOCAL",
+    [XOC_OP_CHANGE_REF_CNT_ASSIGN] = "CHANGE_REF_CNT_ASSIGN",
+    [XOC_OP_UNARY]                 = "UNARY",
+    [XOC_OP_BINARY]                = "BINARY",
+    [XOC_OP_NEG_I64]               = "NEG_I64",
+    [XOC_OP_NEG_F64]               = "NEG_F64",
+    [XOC_OP_NOT_I64]               = "NOT_I64",
+    [XOC_OP_BNOT_I64]              = "BNOT_I64",
+    [XOC_OP_ADD_I64]               = "ADD_I64",
+    [XOC_OP_SUB_I64]               = "SUB_I64",
+    [XOC_OP_MUL_I64]               = "MUL_I64",
+    [XOC_OP_DIV_I64]               = "DIV_I64",
+    [XOC_OP_MOD_I64]               = "MOD_I64",
+    [XOC_OP_AND_I64]               = "AND_I64",
+    [XOC_OP_OR_I64]                = "OR_I64",
+    [XOC_OP_XOR_I64]               = "XOR_I64",
+    [XOC_OP_SHL_I64]               = "SHL_I64",
+    [XOC_OP_SHR_I64]               = "SHR_I64",
+    [XOC_OP_EQ_I64]                = "EQ_I64",
+    [XOC_OP_NE_I64]                = "NE_I64",
+    [XOC_OP_LT_I64]                = "LT_I64",
+    [XOC_OP_LE_I64]                = "LE_I64",
+    [XOC_OP_GT_I64]                = "GT_I64",
+    [XOC_OP_GE_I64]                = "GE_I64",
+    [XOC_OP_DIV_U64]               = "DIV_U64",
+    [XOC_OP_MOD_U64]               = "MOD_U64",
+    [XOC_OP_SHR_U64]               = "SHR_U64",
+    [XOC_OP_LT_U64]                = "LT_U64",
+    [XOC_OP_LE_U64]                = "LE_U64",
+    [XOC_OP_GT_U64]                = "GT_U64",
+    [XOC_OP_GE_U64]                = "GE_U64",
+    [XOC_OP_ADD_F64]               = "ADD_F64",
+    [XOC_OP_SUB_F64]               = "SUB_F64",
+    [XOC_OP_MUL_F64]               = "MUL_F64",
+    [XOC_OP_DIV_F64]               = "DIV_F64",
+    [XOC_OP_EQ_F64]                = "EQ_F64",
+    [XOC_OP_NE_F64]                = "NE_F64",
+    [XOC_OP_LT_F64]                = "LT_F64",
+    [XOC_OP_LE_F64]                = "LE_F64",
+    [XOC_OP_GT_F64]                = "GT_F64",
+    [XOC_OP_GE_F64]                = "GE_F64",
+    [XOC_OP_GET_ARRAY_PTR]         = "GET_ARRAY_PTR",
+    [XOC_OP_GET_DYNARRAY_PTR]      = "GET_DYNARRAY_PTR",
+    [XOC_OP_GET_MAP_PTR]           = "GET_MAP_PTR",
+    [XOC_OP_GET_FIELD_PTR]         = "GET_FIELD_PTR",
+    [XOC_OP_ASSERT_TYPE]           = "ASSERT_TYPE",
+    [XOC_OP_ASSERT_RANGE]          = "ASSERT_RANGE",
+    [XOC_OP_WEAKEN_PTR]            = "WEAKEN_PTR",
+    [XOC_OP_STRENGTHEN_PTR]        = "STRENGTHEN_PTR",
+    [XOC_OP_JMP]                   = "JMP",
+    [XOC_OP_JMP_IF]                = "JMP_IF",
+    [XOC_OP_JMP_IFN]               = "JMP_IFN",
+    [XOC_OP_JMP_IFEQ]              = "JMP_IFEQ",
+    [XOC_OP_JMP_IFNE]              = "JMP_IFNE",
+    [XOC_OP_JMP_IFLT]              = "JMP_IFLT",
+    [XOC_OP_JMP_TBL]               = "JMP_TBL",
+    [XOC_OP_JMP_HASH]              = "JMP_HASH",
+    [XOC_OP_SWITCH]                = "SWITCH",
+    [XOC_OP_CALL]                  = "CALL",
+    [XOC_OP_CALL_INDIRECT]         = "CALL_INDIRECT",
+    [XOC_OP_CALL_EXTERN]           = "CALL_EXTERN",
+    [XOC_OP_CALL_BUILTIN]          = "CALL_BUILTIN",
+    [XOC_OP_RET]                   = "RET",
+    [XOC_OP_ENTER_FRAME]           = "ENTER_FRAME",
+    [XOC_OP_LEAVE_FRAME]           = "LEAVE_FRAME",
+    [XOC_OP_HALT]                  = "HALT",
+};
+
 static const char* device_mnemonic_tbl[] = {
     [XOC_DVC_NONE]      = "none",
     [XOC_DVC_CPU]       = "cpu",
@@ -43,16 +131,157 @@ static const char* device_mnemonic_tbl[] = {
 };
 
 
-type_t* type_alc(typekind_t kind) {
-    type_t* type = (type_t*)malloc(sizeof(type_t));
-    if (!type) {
-        return NULL;
+void typetbl_init(typetbl_t* tbl, arena_t* arena) {
+    tbl->cap = XOC_MIN_TYPE_PAGE;
+    tbl->size = 0;
+    tbl->slot = (type_t**)calloc(tbl->cap, sizeof(type_t*));
+    tbl->page = NULL;
+    tbl->num_free = 0;
+    pool_init(&tbl->pages, arena);
+    memset(tbl->toks, 0, sizeof(tbl->toks));
+    tbl->tmps = tbl->lbls = tbl->anys = NULL;
+    tbl->num_tmp = tbl->num_lbl = tbl->num_any = 0;
+}
+
+void typetbl_free(typetbl_t* tbl) {
+    free(tbl->slot);
+    tbl->slot = NULL;
+    tbl->cap = tbl->size = tbl->num_free = 0;
+    tbl->page = NULL;
+    pool_free(&tbl->pages);
+    memset(tbl->toks, 0, sizeof(tbl->toks));
+    free(tbl->tmps);
+    free(tbl->lbls);
+    free(tbl->anys);
+    tbl->tmps = tbl->lbls = tbl->anys = NULL;
+    tbl->num_tmp = tbl->num_lbl = tbl->num_any = 0;
+}
+
+static uint64_t type_hash(type_t* type) {
+    uint64_t hash = type->kind;
+    hash = (hash ^ type->key) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ type->val.U64) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ (uintptr_t)type->base) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 29);
+}
+
+static bool type_equal(type_t* lhs, type_t* rhs) {
+    return lhs->kind == rhs->kind && lhs->key == rhs->key &&
+           lhs->val.U64 == rhs->val.U64 && lhs->base == rhs->base;
+}
+
+static type_t** type_probe(typetbl_t* tbl, type_t* type) {
+    uint64_t i = type_hash(type);
+    for (;; i++) {
+        type_t** at = &tbl->slot[i & (tbl->cap - 1)];
+        if (!*at || type_equal(*at, type)) {
+            return at;
+        }
+    }
+}
+
+// Nodes are carved from pages owned by the table; without a table every node
+// is a separate allocation released with type_free()
+type_t* type_alc(typetbl_t* tbl, typekind_t kind) {
+    type_t* type;
+    if (!tbl) {
+        type = (type_t*)malloc(sizeof(type_t));
+        if (!type) {
+            return NULL;
+        }
+    } else {
+        if (tbl->num_free == 0) {
+            tbl->page = (type_t*)pool_alc(&tbl->pages, XOC_MIN_TYPE_PAGE * sizeof(type_t));
+            tbl->num_free = XOC_MIN_TYPE_PAGE;
+        }
+        type = tbl->page++;
+        tbl->num_free--;
     }
     memset(type, 0, sizeof(type_t));
     type->kind = kind;
     return type;
 }
 
+type_t* type_dup(typetbl_t* tbl, type_t* type) {
+    type_t* dup = type_alc(tbl, type->kind);
+    if (dup) {
+        *dup = *type;
+    }
+    return dup;
+}
+
+// Entry `id` of a dense cache, grown to cover it
+static type_t** type_dense_at(type_t*** cache, int* num, uint64_t id) {
+    if (id >= (uint64_t)*num) {
+        int cap = *num ? *num : XOC_MIN_TYPE_PAGE;
+        while ((uint64_t)cap <= id) {
+            cap *= 2;
+        }
+        *cache = (type_t**)realloc(*cache, cap * sizeof(type_t*));
+        memset(*cache + *num, 0, (cap - *num) * sizeof(type_t*));
+        *num = cap;
+    }
+    return &(*cache)[id];
+}
+
+// Operators, temps, labels and module names are interned on every use the
+// parser makes of them. Their keys are one small dense ID, so they live in
+// arrays indexed by it and never reach the hash table; NULL for the rest.
+static type_t** type_dense(typetbl_t* tbl, type_t* proto) {
+    if (proto->base) {
+        return NULL;
+    }
+    switch (proto->kind) {
+        case XOC_TYPE_TOK:
+            return !proto->key && proto->val.U64 <= XOC_TOK_EOF ? &tbl->toks[proto->val.U64] : NULL;
+        case XOC_TYPE_TMP:
+            return !proto->key && proto->val.U64 < XOC_MAX_TYPE_DENSE ? type_dense_at(&tbl->tmps, &tbl->num_tmp, proto->val.U64) : NULL;
+        case XOC_TYPE_LBL:
+            return !proto->key && proto->val.U64 < XOC_MAX_TYPE_DENSE ? type_dense_at(&tbl->lbls, &tbl->num_lbl, proto->val.U64) : NULL;
+        case XOC_TYPE_ANY:
+            return !proto->val.U64 && proto->key < XOC_MAX_TYPE_DENSE ? type_dense_at(&tbl->anys, &tbl->num_any, proto->key) : NULL;
+        default:
+            return NULL;
+    }
+}
+
+// Interned nodes are shared and must not be modified: lists that link
+// through `next` or patch `base` build on type_dup() copies instead
+type_t* type_intern(typetbl_t* tbl, type_t* proto) {
+    if (!tbl) {
+        return type_dup(NULL, proto);
+    }
+    type_t** at = type_dense(tbl, proto);
+    if (at) {
+        if (!*at) {
+            *at = type_dup(tbl, proto);
+            (*at)->next = NULL;
+        }
+        return *at;
+    }
+    at = type_probe(tbl, proto);
+    if (*at) {
+        return *at;
+    }
+    if ((tbl->size + 1) * 2 > tbl->cap) {
+        type_t** old = tbl->slot;
+        int old_cap = tbl->cap;
+        tbl->cap *= 2;
+        tbl->slot = (type_t**)calloc(tbl->cap, sizeof(type_t*));
+        for (int i = 0; i < old_cap; i++) {
+            if (old[i]) {
+                *type_probe(tbl, old[i]) = old[i];
+            }
+        }
+        free(old);
+        at = type_probe(tbl, proto);
+    }
+    *at = type_dup(tbl, proto);
+    (*at)->next = NULL;
+    tbl->size++;
+    return *at;
+}
+
 void type_free(type_t* type) {
     if (!type) {
         return;
@@ -69,93 +298,69 @@ void type_free(type_t* type) {
     type = NULL;
 }
 
-type_t* type_any(uint64_t key) {
-    type_t* type = type_alc(XOC_TYPE_ANY);
-    type->key = key;
-    return type;
+type_t* type_any(typetbl_t* tbl, uint32_t sym) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_ANY, .key = sym });
 }
 
-type_t* type_i8(int8_t i8) {
-    type_t* type = type_alc(XOC_TYPE_I8);
-    type->val.I8 = i8;
-    return type;
+// A name resolved to its ident: block locals carry their serial, so a name
+// that shadows another one is a different operand
+type_t* type_idt(typetbl_t* tbl, ident_t* idt) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_ANY, .key = idt->key, .val.U64 = idt->uid });
 }
 
-type_t* type_u8(uint8_t u8) {
-    type_t* type = type_alc(XOC_TYPE_U8);
-    type->val.U8 = u8;
-    return type;
+type_t* type_i8(typetbl_t* tbl, int8_t i8) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_I8, .val.I8 = i8 });
 }
 
-type_t* type_i16(int16_t i16) {
-    type_t* type = type_alc(XOC_TYPE_I16);
-    type->val.I16 = i16;
-    return type;
+type_t* type_u8(typetbl_t* tbl, uint8_t u8) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_U8, .val.U8 = u8 });
 }
-type_t* type_u16(uint16_t u16) {
-    type_t* type = type_alc(XOC_TYPE_U16);
-    type->val.U16 = u16;
-    return type;
+
+type_t* type_i16(typetbl_t* tbl, int16_t i16) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_I16, .val.I16 = i16 });
+}
+type_t* type_u16(typetbl_t* tbl, uint16_t u16) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_U16, .val.U16 = u16 });
 }
 
-type_t* type_i32(int32_t i32) {
-    type_t* type = type_alc(XOC_TYPE_I32);
-    type->val.I32 = i32;
-    return type;
+type_t* type_i32(typetbl_t* tbl, int32_t i32) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_I32, .val.I32 = i32 });
 }
 
-type_t* type_u32(uint32_t u32) {
-    type_t* type = type_alc(XOC_TYPE_U32);
-    type->val.U32 = u32;
-    return type;
+type_t* type_u32(typetbl_t* tbl, uint32_t u32) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_U32, .val.U32 = u32 });
 }
 
-type_t* type_i64(int64_t i64) {
-    type_t* type = type_alc(XOC_TYPE_I64);
-    type->val.I64 = i64;
-    return type;
+type_t* type_i64(typetbl_t* tbl, int64_t i64) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_I64, .val.I64 = i64 });
 }
 
-type_t* type_u64(uint64_t u64) {
-    type_t* type = type_alc(XOC_TYPE_U64);
-    type->val.U64 = u64;
-    return type;
+type_t* type_u64(typetbl_t* tbl, uint64_t u64) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_U64, .val.U64 = u64 });
 }
 
-type_t* type_f32(float f32) {
-    type_t* type = type_alc(XOC_TYPE_F32);
-    type->val.F32 = f32;
-    return type;
+type_t* type_f32(typetbl_t* tbl, float f32) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_F32, .val.F32 = f32 });
 }
 
-type_t* type_f64(double f64) {
-    type_t* type = type_alc(XOC_TYPE_F64);
-    type->val.F64 = f64;
-    return type;
+type_t* type_f64(typetbl_t* tbl, double f64) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_F64, .val.F64 = f64 });
 }
 
-type_t* type_char(char c) {
-    type_t* type = type_alc(XOC_TYPE_CHAR);
-    type->val.I64 = c;
-    return type;
+type_t* type_char(typetbl_t* tbl, char c) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_CHAR, .val.I64 = c });
 }
 
-type_t* type_str(uint64_t key) {
-    type_t* type = type_alc(XOC_TYPE_STR);
-    type->val.WPtr = key;
-    return type;
+type_t* type_str(typetbl_t* tbl, uint64_t key) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_STR, .val.WPtr = key });
 }
 
-type_t* type_tok(tokenkind_t tk) {
-    type_t* type = type_alc(XOC_TYPE_TOK);
-    type->val.WPtr = tk;
-    return type;
+type_t* type_tok(typetbl_t* tbl, tokenkind_t tk) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_TOK, .val.WPtr = tk });
 }
 
-type_t* type_tmp(int id) {
-    type_t* type = type_alc(XOC_TYPE_TMP);
-    type->val.WPtr = id;
-    return type;
+type_t* type_tmp(typetbl_t* tbl, int id) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_TMP, .val.WPtr = id });
 }
 
 int key_is_type(uint64_t key) {
@@ -186,29 +391,20 @@ int key_is_type(uint64_t key) {
 //     }
 // }
 
-type_t* type_blk(int id) {
-    type_t* type = type_alc(XOC_TYPE_BLK);
-    type->val.WPtr = id;
-    return type;
+type_t* type_blk(typetbl_t* tbl, int id) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_BLK, .val.WPtr = id });
 }
 
-type_t* type_lbl(uint64_t key) {
-    type_t* type = type_alc(XOC_TYPE_LBL);
-    type->val.WPtr = key;
-    return type;
+type_t* type_lbl(typetbl_t* tbl, uint32_t sym) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_LBL, .val.WPtr = sym });
 }
 
-type_t* type_dvc(devicekind_t dvc) {
-    type_t* type = type_alc(XOC_TYPE_DVC);
-    type->val.WPtr = dvc;
-    return type;
+type_t* type_dvc(typetbl_t* tbl, devicekind_t dvc) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_DVC, .val.WPtr = dvc });
 }
 
-type_t* type_fn(uint64_t key, type_t* proto) {
-    type_t* type = type_alc(XOC_TYPE_FN);
-    type->key = key;
-    type->base = proto;
-    return type;
+type_t* type_fn(typetbl_t* tbl, uint32_t sym, type_t* proto) {
+    return type_intern(tbl, &(type_t){ .kind = XOC_TYPE_FN, .key = sym, .base = proto });
 }
 
 int type_size(type_t* type) {
@@ -239,15 +435,15 @@ int type_size(type_t* type) {
     };
 }
 
-void type_info(type_t* type, char* buf, int len, map_t* syms) {
+void type_info(type_t* type, char* buf, int len, intern_t* syms) {
     if (!type) return;
     switch (type->kind) {
         case XOC_TYPE_TOK:      snprintf(buf, len, "%s", lexer_mnemonic(type->val.WPtr)); break;
         case XOC_TYPE_TMP:      snprintf(buf, len, "%s%ld", type_mnemonic_tbl[type->kind], type->val.WPtr); break;
         case XOC_TYPE_TYP:      snprintf(buf, len, "%s", type_mnemonic_tbl[type->val.I64]); break;
-        case XOC_TYPE_ANY:      snprintf(buf, len, "%s:%s", map_get(syms, type->key), type_mnemonic_tbl[type->kind]); break;
+        case XOC_TYPE_ANY:      snprintf(buf, len, "%s:%s", intern_get(syms, type->key), type_mnemonic_tbl[type->kind]); break;
         case XOC_TYPE_BLK:      snprintf(buf, len, "%s%ld", type_mnemonic_tbl[type->kind], type->val.WPtr); break;
-        case XOC_TYPE_LBL:      snprintf(buf, len, "%s%s", type_mnemonic_tbl[type->kind], map_get(syms, type->val.WPtr)); break;
+        case XOC_TYPE_LBL:      snprintf(buf, len, "%s%s", type_mnemonic_tbl[type->kind], intern_get(syms, type->val.WPtr)); break;
         case XOC_TYPE_DVC:      snprintf(buf, len, "%s%s", type_mnemonic_tbl[type->kind], device_mnemonic_tbl[type->val.WPtr]); break;
         case XOC_TYPE_I64:      snprintf(buf, len, "%ld:%s", type->val.I64, type_mnemonic_tbl[type->kind]); break;
         case XOC_TYPE_F32:      snprintf(buf, len, "%f:%s", type->val.F32, type_mnemonic_tbl[type->kind]); break;
@@ -257,11 +453,11 @@ void type_info(type_t* type, char* buf, int len, map_t* syms) {
     }
 }
 
-void inst_info(inst_t* inst, char* buf, int len, map_t* syms) {
+void inst_info(inst_t* inst, char* buf, int len, intern_t* syms) {
     char label[64];
     char opr[4][64];
     if(inst->label != 0) {
-        snprintf(label, 64, " %%%-46s │\n│", map_get(syms, inst->label));
+        snprintf(label, 64, " %%%-46s │\n│", intern_get(syms, inst->label));
     } else {
         label[0] = 0;
     }
@@ -280,9 +476,56 @@ void inst_info(inst_t* inst, char* buf, int len, map_t* syms) {
         case XOC_OP_JMP_IFN:    snprintf(buf, len, "%s  JMP_IFN    %s, %s"          , label, opr[0], opr[1]); break;
         case XOC_OP_JMP_IFEQ:   snprintf(buf, len, "%s  JMP_IFEQ   %s, %s == %s"    , label, opr[0], opr[1], opr[2]); break;
         case XOC_OP_JMP_IFNE:   snprintf(buf, len, "%s  JMP_IFNE   %s, %s != %s"    , label, opr[0], opr[1], opr[2]); break;
+        case XOC_OP_SWITCH: {
+            int num = 0;
+            for (type_t* cas = inst->opr[2]; cas; cas = cas->next) {
+                num++;
+            }
+            snprintf(buf, len, "%s  SWITCH     %s, %s ? %d values", label, opr[0], opr[1], num);
+            break;
+        }
         case XOC_OP_RET:        snprintf(buf, len, "%s  RET        "                , label); break;
-        default:                snprintf(buf, len, "%s  UNKNOW     %d"              , label, inst->opc); break;
+        case XOC_OP_NEG_I64:
+        case XOC_OP_NEG_F64:
+        case XOC_OP_NOT_I64:
+        case XOC_OP_BNOT_I64:   snprintf(buf, len, "%s  %-10s %s = %s %s"      , label, opcode_mnemonic_tbl[inst->opc], opr[1], opr[0], opr[2]); break;
+        default:
+            if (inst->opc > XOC_OP_BNOT_I64 && inst->opc <= XOC_OP_GE_F64) {
+                snprintf(buf, len, "%s  %-10s %s = %s %s %s"   , label, opcode_mnemonic_tbl[inst->opc], opr[1], opr[2], opr[0], opr[3]);
+            } else {
+                snprintf(buf, len, "%s  UNKNOW     %d"              , label, inst->opc);
+            }
+            break;
+    }
+}
+
+void code_info(code_t* code, char* buf, int len) {
+    switch (code->opc) {
+        case XOC_OP_UNARY:
+        case XOC_OP_BINARY:     snprintf(buf, len, "  %-10s $%u = $%u %s $%u", opcode_mnemonic_tbl[code->opc], code->a, code->b, lexer_mnemonic(code->imm.I64), code->c); break;
+        case XOC_OP_JMP:        snprintf(buf, len, "  %-10s @%ld", opcode_mnemonic_tbl[code->opc], code->imm.I64); break;
+        case XOC_OP_JMP_IF:
+        case XOC_OP_JMP_IFN:    snprintf(buf, len, "  %-10s @%ld, $%u", opcode_mnemonic_tbl[code->opc], code->imm.I64, code->b); break;
+        case XOC_OP_JMP_IFEQ:
+        case XOC_OP_JMP_IFNE:
+        case XOC_OP_JMP_IFLT:   snprintf(buf, len, "  %-10s @%ld, $%u, $%u", opcode_mnemonic_tbl[code->opc], code->imm.I64, code->b, code->c); break;
+        case XOC_OP_JMP_TBL:    snprintf(buf, len, "  %-10s $%u - %ld < %u", opcode_mnemonic_tbl[code->opc], code->b, code->imm.I64, code->c); break;
+        case XOC_OP_JMP_HASH:   snprintf(buf, len, "  %-10s hash($%u) * %#lx >> %u", opcode_mnemonic_tbl[code->opc], code->b, code->imm.U64, 64 - code->c); break;
+        case XOC_OP_ENTER_FRAME:snprintf(buf, len, "  %-10s %ld, $%u..+%u", opcode_mnemonic_tbl[code->opc], code->imm.I64, code->b, code->c); break;
+        default:                snprintf(buf, len, "  %-10s $%u, $%u, $%u", opcode_mnemonic_tbl[code->opc], code->a, code->b, code->c); break;
+    }
+}
+
+void prog_free(prog_t* prog) {
+    if (prog->code) {
+        free(prog->code);
+        prog->code = NULL;
+    }
+    if (prog->konst) {
+        free(prog->konst);
+        prog->konst = NULL;
     }
+    prog->num_code = prog->num_konst = prog->num_slot = 0;
 }
 
 
@@ -0,0 +1,59 @@
+/**
+ * @file    test.h
+ * @brief   XOC Test Helpers
+ * @details Compile and run a program, then check what a module-level name
+ *          holds once it halts.
+ */
+
+#ifndef XOC_TEST_H
+#define XOC_TEST_H
+
+#include <xoc_compiler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int num_fail = 0;
+
+static void test_quiet(void* ctx, const char* fmt, ...) {
+}
+
+// Value of module-level `name` after running `src`, INT64_MIN when the
+// program does not compile or run to its end or has no slot for `name`
+static int64_t test_run(const char* src, const char* name) {
+    compiler_t cp;
+    compiler_init(&cp, NULL, src, &(compiler_option_t){ .is_pretok_enabled = true });
+    log_setlevel(&cp.log, XOC_NUM_LOGCAT, XOC_LOG_OFF);
+    cp.log.fmt = test_quiet;
+    lexer_eat(&cp.lex, XOC_TOK_NONE);
+    parser_module(&cp.prs);
+    uint32_t sym = intern_find(&cp.sym_tbl, name, strlen(name));
+    int slot = compiler_gen(&cp) == 0 ? gen_slotof(&cp.gen, sym) : -1;
+    int64_t val = INT64_MIN;
+    if (slot >= 0) {
+        engine_t eng;
+        int num_stk = cp.prog.num_slot + cp.prog.num_konst + 1 + XOC_MIN_STK_REDZONE;
+        engine_init(&eng, num_stk > XOC_MIN_MEM_STACK ? num_stk : XOC_MIN_MEM_STACK, false, &cp.log);
+        if (engine_run(&eng, &cp.prog) == 0) {
+            val = eng.fib_cur->stk_base[-1 - slot].I64;
+        }
+        engine_free(&eng);
+    }
+    compiler_free(&cp);
+    return val;
+}
+
+static void test_expect(const char* src, const char* name, int64_t want) {
+    int64_t got = test_run(src, name);
+    if (got != want) {
+        fprintf(stderr, "FAIL: %s is %ld, want %ld for:\n%s\n", name, (long)got, (long)want, src);
+        num_fail++;
+    }
+}
+
+static int test_done(const char* name) {
+    printf("%s: %s\n", name, num_fail ? "FAIL" : "ok");
+    return num_fail != 0;
+}
+
+#endif /* XOC_TEST_H */
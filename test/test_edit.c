@@ -0,0 +1,199 @@
+#include <xoc_compiler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Random edits applied with compiler_edit must leave the same tokens, units,
+// blocks, idents and code as compiling the edited source from scratch.
+// gen_typed specializes insts in place, so insts are only compared on a
+// module code was never generated for.
+
+static const char* lines[] = {
+    "a = 1 + 2 * 3", "if x > 2 { m = 3 } else { m = 4 }", "const c = 5", "s = \"hi\\tx\" + \"ab\"",
+    "for i := 0; i < 10; i = i + 1 { a = a + i }", "// comment", "/* block\n comment */ b = 7",
+    "{ var w : i32 = p; { var c : i32 = w }; w = c }", "{ var c : i32 = 1; c = c + 1 }", "const m = c",
+    "var v : i32 = 12", "switch a + 3 { case 1: a = 1; case 2: a = 2; default: a = 0; }", "",
+    "q = 1.5e3 - 0x1f", "if a && x || b { m = 1 } else { m = 2 }", "t = a || b && !c",
+    "switch a { case 1, 2: a = 3; break; default: }",
+};
+static const char* snips[] = { "1", "+ 2", "\n", ";", "x", "\"", "/*", "*/", "{", "}", " ", "if ", "abc = 3\n", "\"str\"", "//" };
+
+static char src[1 << 16];
+static int len;
+
+static void quiet(void* ctx, const char* fmt, ...) {
+}
+
+static void open_src(compiler_t* cp) {
+    compiler_init(cp, NULL, src, &(compiler_option_t){ .is_pretok_enabled = false });
+    cp->log.fmt = quiet;
+    cp->opt.is_pretok_enabled = true;
+    lexer_tokenize(&cp->lex, &cp->toks);
+    lexer_eat(&cp->lex, XOC_TOK_NONE);
+    parser_module(&cp->prs);
+}
+
+static const char* diff(compiler_t* a, compiler_t* b, bool is_gen) {
+    tokbuf_t *ta = a->lex.toks, *tb = b->lex.toks;
+    if (strcmp(lexer_src(&a->lex), lexer_src(&b->lex))) {
+        return "source";
+    }
+    if (ta->size != tb->size) {
+        return "token count";
+    }
+    for (int i = 0; i < ta->size; i++) {
+        int x = tokbuf_slot(ta, i), y = tokbuf_slot(tb, i);
+        if (ta->kind[x] != tb->kind[y] || tokbuf_off(ta, i) != tokbuf_off(tb, i) || ta->len[x] != tb->len[y]) {
+            return "token";
+        }
+        if (ta->kind[x] == XOC_TOK_IDT && strcmp(intern_get(&a->sym_tbl, ta->val[x]), intern_get(&b->sym_tbl, tb->val[y]))) {
+            return "token ident";
+        }
+        if ((ta->kind[x] == XOC_TOK_INT_LIT || ta->kind[x] == XOC_TOK_REAL_LIT || ta->kind[x] == XOC_TOK_CHAR_LIT) && ta->val[x] != tb->val[y]) {
+            return "token value";
+        }
+    }
+    if (a->prs.num_unit != b->prs.num_unit) {
+        return "unit count";
+    }
+    for (int i = 0; i < a->prs.num_unit; i++) {
+        unit_t x = parser_unit_at(&a->prs, i), y = parser_unit_at(&b->prs, i);
+        if (memcmp(&x, &y, sizeof(unit_t))) {
+            return "units";
+        }
+    }
+    if (a->blks.size != b->blks.size) {
+        return "block count";
+    }
+    for (int n = 0; n < a->blks.size; n++) {
+        inst_t *x = (inst_t*)pool_nat(&a->blks, n), *y = (inst_t*)pool_nat(&b->blks, n);
+        if (pool_nsize(x) != pool_nsize(y)) {
+            return "block size";
+        }
+        for (int i = 0; !is_gen && i < pool_nsize(x); i++) {
+            if (x[i].opc != y[i].opc) {
+                return "inst";
+            }
+        }
+    }
+    if (pool_nsize(a->prs.idt_cur) != pool_nsize(b->prs.idt_cur)) {
+        return "ident count";
+    }
+    for (int i = 0; i < pool_nsize(a->prs.idt_cur); i++) {
+        ident_t *x = &a->prs.idt_cur[i], *y = &b->prs.idt_cur[i];
+        if (x->kind != y->kind || x->is_global != y->is_global || (x->kind != XOC_IDT_LABEL && strcmp(x->name, y->name))) {
+            return "ident";
+        }
+        if (x->is_global && x->kind != XOC_IDT_LABEL && x->shadow != y->shadow) {
+            return "ident binding";
+        }
+    }
+    if (!is_gen) {
+        return NULL;
+    }
+    compiler_gen(a);
+    compiler_gen(b);
+    if (a->prog.num_code != b->prog.num_code) {
+        return "code count";
+    }
+    for (int i = 0; i < a->prog.num_code; i++) {
+        if (a->prog.code[i].opc != b->prog.code[i].opc) {
+            return "code";
+        }
+    }
+    return NULL;
+}
+
+static int run(unsigned seed, int num_line, int num_edit, bool is_gen) {
+    srand(seed);
+    len = 0;
+    for (int i = 0; i < num_line; i++) {
+        len += sprintf(src + len, "%s\n", lines[rand() % (sizeof(lines) / sizeof(*lines))]);
+    }
+    compiler_t inc;
+    open_src(&inc);
+    for (int e = 0; e < num_edit; e++) {
+        int off = rand() % (len + 1), num_del = 0;
+        const char* ins = "";
+        int r = rand() % 3;
+        if (r != 1) {
+            num_del = rand() % (r == 0 ? 6 : 3);
+            num_del = off + num_del > len ? len - off : num_del;
+        }
+        if (r != 0) {
+            ins = snips[rand() % (sizeof(snips) / sizeof(*snips))];
+        }
+        int num_ins = strlen(ins);
+        if (len + num_ins >= (int)sizeof(src)) {
+            break;
+        }
+        memmove(src + off + num_ins, src + off + num_del, len - off - num_del + 1);
+        memcpy(src + off, ins, num_ins);
+        len += num_ins - num_del;
+        compiler_edit(&inc, off, num_del, ins, num_ins);
+        if (e % 10 == 0 || e == num_edit - 1) {
+            compiler_t ref;
+            open_src(&ref);
+            const char* what = diff(&inc, &ref, is_gen);
+            compiler_free(&ref);
+            if (what) {
+                fprintf(stderr, "FAIL: seed %u edit %d (%d-%d \"%s\"): %s differs\n", seed, e, off, num_del, ins, what);
+                compiler_free(&inc);
+                return 1;
+            }
+        }
+    }
+    compiler_free(&inc);
+    return 0;
+}
+
+// Microseconds per edit in the middle of `num_repeat` units, best of a few
+// rounds, once the first edit has moved the gaps there
+static double cost(int num_repeat) {
+    static const char* unit = "const lim = 16 - 7\nif a <= lim { a = a * b } else { s = 9 - b }\n";
+    int unit_len = strlen(unit), big_len = unit_len * num_repeat;
+    char* big = malloc(big_len + 1);
+    for (int i = 0; i < num_repeat; i++) {
+        memcpy(big + i * unit_len, unit, unit_len);
+    }
+    big[big_len] = '\0';
+    compiler_t cp;
+    compiler_init(&cp, NULL, big, &(compiler_option_t){ .is_pretok_enabled = true });
+    lexer_eat(&cp.lex, XOC_TOK_NONE);
+    parser_module(&cp.prs);
+    int off = num_repeat / 2 * unit_len + 17;
+    compiler_edit(&cp, off, 1, "8", 1);
+    double best = 1e9;
+    for (int round = 0; round < 5; round++) {
+        clock_t t0 = clock();
+        // Replace a digit, type and erase one, then a whole `+ 1`
+        for (int i = 0; i < 100; i++) {
+            compiler_edit(&cp, off, 1, i % 2 ? "8" : "7", 1);
+            compiler_edit(&cp, off + 1, 0, "1", 1);
+            compiler_edit(&cp, off + 1, 1, "", 0);
+            compiler_edit(&cp, off + 1, 0, " + 1", 4);
+            compiler_edit(&cp, off + 1, 4, "", 0);
+        }
+        double us = (clock() - t0) * 1e6 / CLOCKS_PER_SEC / 500;
+        best = us < best ? us : best;
+    }
+    compiler_free(&cp);
+    free(big);
+    return best;
+}
+
+int main(void) {
+    int num_fail = 0;
+    for (unsigned seed = 1; seed <= 8; seed++) {
+        num_fail += run(seed, 60, 400, seed > 4);
+    }
+    // Edits cost the same in a module 32 times the size
+    double small = cost(1000), large = cost(32000);
+    if (large > small * 4 + 2) {
+        fprintf(stderr, "FAIL: an edit takes %.2f us in 1000 units, %.2f us in 32000\n", small, large);
+        num_fail++;
+    }
+    printf("test_edit: %s\n", num_fail ? "FAIL" : "ok");
+    return num_fail != 0;
+}
@@ -0,0 +1,41 @@
+#include "test.h"
+
+// A module with `num` names, each assigned its own constant: two slots apiece
+static char* gen_src(int num) {
+    char* src = (char*)malloc(num * 24 + 1);
+    int len = 0;
+    for (int i = 0; i < num; i++) {
+        len += sprintf(src + len, "v%d = %d\n", i, i + 1000);
+    }
+    src[len] = '\0';
+    return src;
+}
+
+static void expect_lowered(int num, bool is_ok) {
+    char* src = gen_src(num);
+    compiler_t cp;
+    compiler_init(&cp, NULL, src, &(compiler_option_t){ .is_pretok_enabled = true });
+    log_setlevel(&cp.log, XOC_NUM_LOGCAT, XOC_LOG_OFF);
+    cp.log.fmt = test_quiet;
+    lexer_eat(&cp.lex, XOC_TOK_NONE);
+    parser_module(&cp.prs);
+    int res = compiler_gen(&cp);
+    if ((res == 0) != is_ok || (!is_ok && (cp.prog.code || cp.prog.num_code))) {
+        fprintf(stderr, "FAIL: %d names lowered with %d, %d codes\n", num, res, cp.prog.num_code);
+        num_fail++;
+    }
+    compiler_free(&cp);
+    free(src);
+}
+
+int main(void) {
+    // Just under the 16-bit slot limit the frame still fits and runs
+    char* src = gen_src(32000);
+    test_expect(src, "v31999", 32999);
+    free(src);
+    expect_lowered(32767, true);
+    // Past it, nothing is emitted instead of slot numbers wrapping
+    expect_lowered(32768, false);
+    expect_lowered(40000, false);
+    return test_done("test_gen");
+}
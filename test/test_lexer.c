@@ -0,0 +1,46 @@
+#include <xoc_compiler.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int num_log = 0;
+static int num_fail = 0;
+
+static void count(void* ctx, const char* fmt, ...) {
+    num_log++;
+}
+
+// Lex `src` on its own and check it is one integer literal of value `want`,
+// `is_err` when the lexer should report it
+static void expect_int(const char* src, uint64_t want, bool is_err) {
+    intern_t syms;
+    info_t info;
+    log_t log;
+    lexer_t lex;
+    intern_init(&syms);
+    info_init(&info, "main", src, 1, 1, 0);
+    log_init(&log, &info, count);
+    lexer_init(&lex, src, false, &syms, &info, &log);
+    num_log = 0;
+    lexer_next(&lex);
+    if (lex.cur.kind != XOC_TOK_INT_LIT || lex.cur.Uint != want || (num_log != 0) != is_err) {
+        fprintf(stderr, "FAIL: `%s` lexed to %llu (%d messages), want %llu\n", src, (unsigned long long)lex.cur.Uint, num_log, (unsigned long long)want);
+        num_fail++;
+    }
+    lexer_free(&lex);
+    intern_free(&syms);
+}
+
+int main(void) {
+    // The 20-digit literals up to UINT64_MAX fit
+    expect_int("18446744073709551609", 18446744073709551609ULL, false);
+    expect_int("18446744073709551610", 18446744073709551610ULL, false);
+    expect_int("18446744073709551614", 18446744073709551614ULL, false);
+    expect_int("18446744073709551615", 18446744073709551615ULL, false);
+    expect_int("18_446_744_073_709_551_615", 18446744073709551615ULL, false);
+    // One past it does not
+    expect_int("18446744073709551616", 1844674407370955161ULL, true);
+    expect_int("184467440737095516150", 18446744073709551615ULL, true);
+    expect_int("0", 0, false);
+    printf("test_lexer: %s\n", num_fail ? "FAIL" : "ok");
+    return num_fail != 0;
+}
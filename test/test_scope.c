@@ -0,0 +1,17 @@
+#include "test.h"
+
+int main(void) {
+    // An inner var has its own slot, the outer one is visible again after it
+    test_expect("x = 1\n"
+                "{ var x : i32 = 2; x = x + 1 }\n", "x", 1);
+    // A var is in scope only after its value, which still reads the outer one
+    test_expect("x = 4\n"
+                "{ var x : i32 = x + 1; { var x : i32 = x * 10; z = x } }\n", "z", 50);
+    // A shadowing constant propagates its own value, not the outer one's
+    test_expect("const c = 5\n"
+                "{ const c = 7; w = c }\n"
+                "z = c\n", "z", 5);
+    test_expect("const c = 5\n"
+                "{ const c = 7; z = c + 1 }\n", "z", 8);
+    return test_done("test_scope");
+}
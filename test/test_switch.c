@@ -0,0 +1,34 @@
+#include "test.h"
+
+int main(void) {
+    // A body without break runs into the next case's test, not its body
+    test_expect("x = 1\nr = 0\n"
+                "switch x { case 1: r = r * 10 + 1; case 2: r = r * 10 + 2; break; case 1: r = r * 10 + 3; }\n", "r", 13);
+    // A default is taken where it stands once control reaches it
+    test_expect("x = 5\nr = 0\n"
+                "switch x { case 1: r = 1; break; default: r = r * 10 + 7; case 5: r = r * 10 + 5; break; }\n", "r", 75);
+    // Case values are computed in turn: the division by zero is never reached
+    test_expect("x = 1\nd = 0\nr = 0\n"
+                "switch x { case 1: r = 4; break; case 1 / d: r = 5; break; }\n", "r", 4);
+    // A short-circuit case value
+    test_expect("x = 1\na = 2\nb = 0\nr = 0\n"
+                "switch x { case a && b: r = 1; break; case a || b: r = 2; break; }\n", "r", 2);
+    // Every body breaks: dispatched from the head
+    test_expect("x = 6\nr = 0\n"
+                "switch x { case 1: r = 1; break; case 2: r = 2; break; case 3: r = 3; break; case 4: r = 4; break; "
+                "case 5: r = 5; break; case 6: r = 6; break; default: r = 9; }\n", "r", 6);
+    // Strings are hashed and compared by contents, whatever else the selector holds
+    test_expect("x = \"c\"\nr = 0\n"
+                "switch x { case \"a\": r = 1; break; case \"b\": r = 2; break; case \"c\": r = 3; break; case \"d\": r = 4; break; }\n", "r", 3);
+    test_expect("y = \"d\"\nx = y\nif r { x = 5 }\nr = 0\n"
+                "switch x { case \"a\": r = 1; break; case \"b\": r = 2; break; case \"c\": r = 3; break; case \"d\": r = 4; break; }\n", "r", 4);
+    test_expect("x = \"e\"\nr = 0\n"
+                "switch x { case \"a\": r = 1; break; case \"b\": r = 2; break; case \"c\": r = 3; break; case \"d\": r = 4; break; default: r = 9; }\n", "r", 9);
+    // An unset selector holds no string and takes the default
+    test_expect("r = 0\n"
+                "switch x { case \"a\": r = 1; break; case \"b\": r = 2; break; case \"c\": r = 3; break; case \"d\": r = 4; break; default: r = 9; }\n", "r", 9);
+    // Few strings stay a chain of content compares
+    test_expect("y = \"b\"\nx = y\nr = 0\n"
+                "switch x { case \"a\": r = 1; break; case \"b\": r = 2; break; }\n", "r", 2);
+    return test_done("test_switch");
+}